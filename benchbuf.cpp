@@ -0,0 +1,1382 @@
+// Throughput benchmarks for the buffer manager.  Every benchmark also
+// checks the page contents it sees, so the program doubles as a stress
+// test: it exits with status 1 as soon as something is wrong.
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include "page.h"
+#include "buf.h"
+#include "io.h"
+#include "heapfile.h"
+
+
+#define CALL(c)    { Status s; \
+                     if ((s = c) != OK) { \
+		       cerr << "At line " << __LINE__ << ":" << endl << "  "; \
+                       error.print(s); \
+                       cerr << "BENCHMARK FAILED" <<endl; \
+                       exit(1); \
+                     } \
+                   }
+
+BufMgr*     bufMgr;
+Error       error;
+DB          db;
+
+// wall clock time in seconds
+static double now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// creates fileName with numPages pages, each stamped with its page number
+static File* makeFile(const char* fileName, const int numPages)
+{
+  File* file;
+  Page* page;
+  pageno_t pageNo;
+
+  struct stat statusBuf;
+  if (lstat(fileName, &statusBuf) == 0)
+    (void)db.destroyFile(fileName);
+  CALL(db.createFile(fileName));
+  CALL(db.openFile(fileName, file));
+  for (int i = 0; i < numPages; i++) {
+    CALL(bufMgr->allocPage(file, pageNo, page));
+    sprintf((char*)page, "%s Page %lld", fileName, pageNo);
+    CALL(bufMgr->unPinPage(file, pageNo, true));
+  }
+  return file;
+}
+
+static void dropFile(const char* fileName, File* file)
+{
+  CALL(db.closeFile(file));
+  CALL(db.destroyFile(fileName));
+}
+
+
+//----------------------------------------------------------------------
+// Concurrent readPage/unPinPage
+//----------------------------------------------------------------------
+
+struct HammerArgs
+{
+  File*		file;     // file to read from
+  const char*	fileName; // its name, as stamped on every page
+  int		numPages; // pages 1..numPages are read
+  int		ops;      // number of readPage/unPinPage pairs
+  unsigned int	seed;     // private random state
+  int		errors;   // number of failed calls or bad pages
+};
+
+static void* hammer(void* arg)
+{
+  HammerArgs* a = (HammerArgs*)arg;
+  char cmp[PAGESIZE];
+  Page* page;
+
+  for (int i = 0; i < a->ops; i++) {
+    int pageNo = 1 + rand_r(&a->seed) % a->numPages;
+    if (bufMgr->readPage(a->file, pageNo, page) != OK) {
+      a->errors++;
+      continue;
+    }
+    sprintf(cmp, "%s Page %d", a->fileName, pageNo);
+    if (memcmp(page, cmp, strlen(cmp)) != 0)
+      a->errors++;
+    if (bufMgr->unPinPage(a->file, pageNo, false) != OK)
+      a->errors++;
+  }
+  return NULL;
+}
+
+// runs readPage/unPinPage from 1, 2, 4 and 8 threads against a pool of
+// poolSize frames in numShards shards, reading a file of numPages pages
+static void benchThreads(const int poolSize, const int numShards,
+			 const int numPages, const int opsPerThread,
+			 const Replacement policy = CLOCK)
+{
+  const char* fileName = "bench.1";
+  bufMgr = new BufMgr(poolSize, numShards, policy);
+  File* file = makeFile(fileName, numPages);
+
+  cout << "readPage/unPinPage, " << poolSize << " frames in " << numShards
+       << " shards, " << numPages << " pages in file" << endl;
+  for (int numThreads = 1; numThreads <= 8; numThreads *= 2) {
+    pthread_t threads[8];
+    HammerArgs args[8];
+    bufMgr->clearBufStats();
+    double start = now();
+    for (int t = 0; t < numThreads; t++) {
+      args[t].file = file;
+      args[t].fileName = fileName;
+      args[t].numPages = numPages;
+      args[t].ops = opsPerThread;
+      args[t].seed = 17 * t + 1;
+      args[t].errors = 0;
+      pthread_create(&threads[t], NULL, hammer, &args[t]);
+    }
+    int errors = 0;
+    for (int t = 0; t < numThreads; t++) {
+      pthread_join(threads[t], NULL);
+      errors += args[t].errors;
+    }
+    double elapsed = now() - start;
+    if (errors != 0) {
+      cerr << errors << " errors with " << numThreads << " threads" << endl;
+      cerr << "BENCHMARK FAILED" << endl;
+      exit(1);
+    }
+    const BufStats stats = bufMgr->getBufStats();
+    cout << "  " << numThreads << " threads: "
+	 << (long)(numThreads * opsPerThread / elapsed) << " ops/sec, "
+	 << (long)(opsPerThread / elapsed) << " ops/sec/thread, "
+	 << stats.diskreads << " disk reads" << endl;
+  }
+
+  dropFile(fileName, file);
+  delete bufMgr;
+  bufMgr = NULL;
+}
+
+
+//----------------------------------------------------------------------
+// Page table lookups: BufHashTbl against the chained table it replaced
+//----------------------------------------------------------------------
+
+// The separately chained hash table BufMgr used to have, kept here as
+// the baseline.  The only change is an unsigned hash, since the original
+// could go negative once the File pointer was truncated to an int.
+class ChainedHashTbl
+{
+private:
+  struct chainBucket
+  {
+    const File*  file;
+    int          pageNo;
+    int          frameNo;
+    chainBucket* next;
+  };
+  int HTSIZE;
+  chainBucket** ht;
+  int hash(const File* file, const int pageNo)
+  {
+    return (unsigned int)((long)file + pageNo) % HTSIZE;
+  }
+
+public:
+  ChainedHashTbl(const int htSize)
+  {
+    HTSIZE = htSize;
+    ht = new chainBucket* [htSize];
+    for (int i = 0; i < HTSIZE; i++)
+      ht[i] = NULL;
+  }
+  ~ChainedHashTbl()
+  {
+    for (int i = 0; i < HTSIZE; i++)
+      while (ht[i]) {
+	chainBucket* tmpBuc = ht[i];
+	ht[i] = ht[i]->next;
+	delete tmpBuc;
+      }
+    delete [] ht;
+  }
+  Status insert(const File* file, const int pageNo, const int frameNo)
+  {
+    int index = hash(file, pageNo);
+    for (chainBucket* b = ht[index]; b; b = b->next)
+      if (b->file == file && b->pageNo == pageNo)
+	return HASHTBLERROR;
+    chainBucket* tmpBuc = new chainBucket;
+    tmpBuc->file = file;
+    tmpBuc->pageNo = pageNo;
+    tmpBuc->frameNo = frameNo;
+    tmpBuc->next = ht[index];
+    ht[index] = tmpBuc;
+    return OK;
+  }
+  Status lookup(const File* file, const int pageNo, int& frameNo)
+  {
+    for (chainBucket* b = ht[hash(file, pageNo)]; b; b = b->next)
+      if (b->file == file && b->pageNo == pageNo) {
+	frameNo = b->frameNo;
+	return OK;
+      }
+    return HASHNOTFOUND;
+  }
+  Status remove(const File* file, const int pageNo)
+  {
+    chainBucket** prev = &ht[hash(file, pageNo)];
+    for (chainBucket* b = *prev; b; prev = &b->next, b = b->next)
+      if (b->file == file && b->pageNo == pageNo) {
+	*prev = b->next;
+	delete b;
+	return OK;
+      }
+    return HASHTBLERROR;
+  }
+};
+
+// Fills a table with numFrames pages spread over a few files, then
+// measures random lookups and a churn of remove/insert pairs (what
+// every eviction does).  Returns lookups per second.
+template <class Table>
+static double benchTable(Table& table, const int numFrames,
+			 const int numLookups, double& churnPerSec)
+{
+  static char files[8];   // only the addresses are used, as File pointers
+  const int numFiles = 8;
+  int* pageOf = new int[numFrames];
+  int frameNo;
+  unsigned int seed = 1;
+
+  for (int i = 0; i < numFrames; i++) {
+    pageOf[i] = i / numFiles + 1;
+    CALL(table.insert((File*)&files[i % numFiles], pageOf[i], i));
+  }
+
+  double start = now();
+  for (int n = 0; n < numLookups; n++) {
+    int i = rand_r(&seed) % numFrames;
+    if (table.lookup((File*)&files[i % numFiles], pageOf[i], frameNo) != OK
+	|| frameNo != i) {
+      cerr << "lookup of frame " << i << " failed" << endl;
+      cerr << "BENCHMARK FAILED" << endl;
+      exit(1);
+    }
+  }
+  double lookupsPerSec = numLookups / (now() - start);
+
+  // replace each resident page by a page that is not resident yet
+  start = now();
+  int nextPage = numFrames / numFiles + 1;
+  for (int n = 0; n < numLookups / 4; n++) {
+    int i = rand_r(&seed) % numFrames;
+    CALL(table.remove((File*)&files[i % numFiles], pageOf[i]));
+    pageOf[i] = nextPage++;
+    CALL(table.insert((File*)&files[i % numFiles], pageOf[i], i));
+  }
+  churnPerSec = (numLookups / 4) / (now() - start);
+
+  for (int i = 0; i < numFrames; i++)
+    if (table.lookup((File*)&files[i % numFiles], pageOf[i], frameNo) != OK
+	|| frameNo != i) {
+      cerr << "frame " << i << " lost after churn" << endl;
+      cerr << "BENCHMARK FAILED" << endl;
+      exit(1);
+    }
+
+  delete [] pageOf;
+  return lookupsPerSec;
+}
+
+static void benchHashTables()
+{
+  const int sizes[] = { 1000, 100000, 1000000 };
+  const int numLookups = 2000000;
+
+  cout << "page table lookups, chained vs open addressing" << endl;
+  for (int i = 0; i < 3; i++) {
+    double chainedChurn, openChurn;
+    ChainedHashTbl* chained =
+      new ChainedHashTbl(((((int) (sizes[i] * 1.2))*2)/2)+1);
+    double chainedLookups = benchTable(*chained, sizes[i], numLookups, chainedChurn);
+    delete chained;
+    BufHashTbl* open = new BufHashTbl(sizes[i]);
+    double openLookups = benchTable(*open, sizes[i], numLookups, openChurn);
+    delete open;
+    cout << "  " << sizes[i] << " frames: chained "
+	 << (long)chainedLookups << " lookups/sec, "
+	 << (long)chainedChurn << " evictions/sec; open addressing "
+	 << (long)openLookups << " lookups/sec, "
+	 << (long)openChurn << " evictions/sec" << endl;
+  }
+}
+
+
+//----------------------------------------------------------------------
+// Hit ratio of each replacement policy on point lookups mixed with scans
+//----------------------------------------------------------------------
+
+// reads pageNo of fileName through the pool and checks its stamp
+static void readAndCheck(File* file, const char* fileName, const pageno_t pageNo)
+{
+  char cmp[PAGESIZE];
+  Page* page;
+
+  CALL(bufMgr->readPage(file, pageNo, page));
+  sprintf(cmp, "%s Page %lld", fileName, pageNo);
+  if (memcmp(page, cmp, strlen(cmp)) != 0) {
+    cerr << "page " << pageNo << " of " << fileName << " is corrupt" << endl;
+    cerr << "BENCHMARK FAILED" << endl;
+    exit(1);
+  }
+  CALL(bufMgr->unPinPage(file, pageNo, false));
+}
+
+// A hot set of hotPages index pages, half the size of the pool, is read
+// at random; every third request instead continues a sequential scan
+// over the rest of the file.
+static void benchPolicies(const int poolSize, const int hotPages,
+			  const int numPages, const int numOps)
+{
+  const char* fileName = "bench.2";
+  const char* names[] = { "clock", "LRU-2", "2Q", "ARC" };
+  const Replacement policies[] = { CLOCK, LRUK, TWOQ, ARC };
+
+  cout << "hit ratio, " << poolSize << " frames, " << hotPages
+       << " hot pages, scans over " << numPages << " pages" << endl;
+  for (int p = 0; p < 4; p++) {
+    bufMgr = new BufMgr(poolSize, 1, policies[p]);
+    File* file = makeFile(fileName, numPages);
+    CALL(bufMgr->flushFile(file));
+    bufMgr->clearBufStats();
+
+    unsigned int seed = 1;
+    int scanPage = hotPages;
+    for (int n = 0; n < numOps; n++) {
+      if (n % 3 == 2) {
+	scanPage = scanPage < numPages ? scanPage + 1 : hotPages + 1;
+	readAndCheck(file, fileName, scanPage);
+      } else
+	readAndCheck(file, fileName, 1 + rand_r(&seed) % hotPages);
+    }
+
+    const BufStats stats = bufMgr->getBufStats();
+    cout << "  " << names[p] << ": "
+	 << 100.0 * (stats.accesses - stats.diskreads) / stats.accesses
+	 << "% of requests hit, "
+	 << 100.0 * (stats.accesses - stats.diskreads) / (2 * numOps / 3.0)
+	 << "% of point lookups hit (scan pages never can)" << endl;
+    dropFile(fileName, file);
+    delete bufMgr;
+    bufMgr = NULL;
+  }
+}
+
+
+//----------------------------------------------------------------------
+// Foreground writes with and without the background writer
+//----------------------------------------------------------------------
+
+// Rewrites random pages of a file four times the size of the pool, once
+// without and once with the background writer, and reports how many of
+// the write-backs readPage callers had to wait for.
+static void benchWriter(const int poolSize, const int numPages,
+			const int numOps)
+{
+  const char* fileName = "bench.3";
+
+  cout << "random page updates, " << poolSize << " frames, " << numPages
+       << " pages in file" << endl;
+  for (int withWriter = 0; withWriter <= 1; withWriter++) {
+    bufMgr = new BufMgr(poolSize, 4);
+    File* file = makeFile(fileName, numPages);
+    CALL(bufMgr->flushFile(file));
+    if (withWriter)
+      CALL(bufMgr->startWriter(1, poolSize / 4));
+    bufMgr->clearBufStats();
+
+    unsigned int seed = 1;
+    char cmp[PAGESIZE];
+    Page* page;
+    double start = now();
+    for (int n = 0; n < numOps; n++) {
+      int pageNo = 1 + rand_r(&seed) % numPages;
+      CALL(bufMgr->readPage(file, pageNo, page));
+      sprintf(cmp, "%s Page %d", fileName, pageNo);
+      if (memcmp(page, cmp, strlen(cmp)) != 0) {
+	cerr << "page " << pageNo << " is corrupt" << endl;
+	cerr << "BENCHMARK FAILED" << endl;
+	exit(1);
+      }
+      CALL(bufMgr->unPinPage(file, pageNo, true));
+    }
+    double elapsed = now() - start;
+    bufMgr->stopWriter();
+
+    const BufStats stats = bufMgr->getBufStats();
+    cout << "  " << (withWriter ? "with" : "without") << " writer: "
+	 << (long)(numOps / elapsed) << " ops/sec, " << stats.fgwrites
+	 << " foreground writes, " << stats.bgwrites
+	 << " background writes" << endl;
+    dropFile(fileName, file);
+    delete bufMgr;
+    bufMgr = NULL;
+  }
+}
+
+
+//----------------------------------------------------------------------
+// Sequential scans with and without readahead
+//----------------------------------------------------------------------
+
+static void benchReadAhead(const int poolSize, const int numPages,
+			   const int numScans)
+{
+  const char* fileName = "bench.4";
+
+  cout << "sequential scans, " << poolSize << " frames, " << numPages
+       << " pages in file" << endl;
+  for (int withReadAhead = 0; withReadAhead <= 1; withReadAhead++) {
+    bufMgr = new BufMgr(poolSize, 4);
+    File* file = makeFile(fileName, numPages);
+    CALL(bufMgr->flushFile(file));
+    if (withReadAhead)
+      bufMgr->setReadAhead(64);
+    bufMgr->clearBufStats();
+
+    double start = now();
+    for (int n = 0; n < numScans; n++)
+      for (int pageNo = 1; pageNo <= numPages; pageNo++)
+	readAndCheck(file, fileName, pageNo);
+    double elapsed = now() - start;
+
+    const BufStats stats = bufMgr->getBufStats();
+    cout << "  " << (withReadAhead ? "with" : "without") << " readahead: "
+	 << (long)(numScans * numPages / elapsed) << " pages/sec, "
+	 << stats.accesses - (stats.diskreads - stats.prefetches)
+	 << " of " << stats.accesses << " requests found their page cached"
+	 << endl;
+    dropFile(fileName, file);
+    delete bufMgr;
+    bufMgr = NULL;
+  }
+}
+
+
+//----------------------------------------------------------------------
+// Batched pins: readPage per page against readPages per batch
+//----------------------------------------------------------------------
+
+static void benchBatches(const int poolSize, const int numPages,
+			 const int batch, const int numScans)
+{
+  const char* fileName = "bench.5";
+  Page** pages = new Page* [batch];
+  char cmp[PAGESIZE];
+
+  cout << "cold sequential reads in batches of " << batch << ", "
+       << poolSize << " frames, " << numPages << " pages in file" << endl;
+  bufMgr = new BufMgr(poolSize, 4);
+  File* file = makeFile(fileName, numPages);
+  for (int batched = 0; batched <= 1; batched++) {
+    double elapsed = 0;
+    for (int n = 0; n < numScans; n++) {
+      // start every scan with none of the file cached
+      CALL(bufMgr->flushFile(file));
+      double start = now();
+      for (int first = 1; first + batch - 1 <= numPages; first += batch) {
+	if (batched)
+	  CALL(bufMgr->readPages(file, first, batch, pages))
+	else
+	  for (int i = 0; i < batch; i++)
+	    CALL(bufMgr->readPage(file, first + i, pages[i]));
+	for (int i = 0; i < batch; i++) {
+	  sprintf(cmp, "%s Page %d", fileName, first + i);
+	  if (memcmp(pages[i], cmp, strlen(cmp)) != 0) {
+	    cerr << "page " << first + i << " is corrupt" << endl;
+	    cerr << "BENCHMARK FAILED" << endl;
+	    exit(1);
+	  }
+	}
+	if (batched)
+	  CALL(bufMgr->unPinPages(file, first, batch, false))
+	else
+	  for (int i = 0; i < batch; i++)
+	    CALL(bufMgr->unPinPage(file, first + i, false));
+      }
+      elapsed += now() - start;
+    }
+    cout << "  " << (batched ? "readPages" : "readPage") << ": "
+	 << (long)(numScans * (numPages / batch * batch) / elapsed)
+	 << " pages/sec" << endl;
+  }
+  dropFile(fileName, file);
+  delete bufMgr;
+  bufMgr = NULL;
+  delete [] pages;
+}
+
+
+//----------------------------------------------------------------------
+// flushFile of a small file in a large pool
+//----------------------------------------------------------------------
+
+static void benchFlush(const int poolSize, const int filePages,
+		       const int numFlushes)
+{
+  const char* fileName = "bench.6";
+  Page* page;
+
+  bufMgr = new BufMgr(poolSize, 4);
+  File* file = makeFile(fileName, filePages);
+  double start = now();
+  for (int n = 0; n < numFlushes; n++) {
+    // dirty every other page so that the writes cannot all be coalesced
+    for (int pageNo = 1; pageNo <= filePages; pageNo++) {
+      CALL(bufMgr->readPage(file, pageNo, page));
+      CALL(bufMgr->unPinPage(file, pageNo, pageNo % 2 == 0));
+    }
+    CALL(bufMgr->flushFile(file));
+  }
+  double elapsed = now() - start;
+  cout << "flushFile of a " << filePages << " page file, " << poolSize
+       << " frames: " << (long)(numFlushes / elapsed) << " flushes/sec"
+       << endl;
+  dropFile(fileName, file);
+  delete bufMgr;
+  bufMgr = NULL;
+}
+
+
+//----------------------------------------------------------------------
+// Miss path: every read evicts a page, of one of several files
+//----------------------------------------------------------------------
+
+static void benchMisses(const int poolSize, const int numFiles,
+			const int filePages, const int numScans)
+{
+  char fileName[32];
+  vector<string> names(numFiles);
+  vector<File*> files(numFiles);
+
+  bufMgr = new BufMgr(poolSize, 4);
+  for (int f = 0; f < numFiles; f++) {
+    sprintf(fileName, "bench.%d", 18 + f);
+    names[f] = fileName;
+    files[f] = makeFile(fileName, filePages);
+    CALL(bufMgr->flushFile(files[f]));
+  }
+  // the files together are larger than the pool, so reading them round
+  // robin misses every time
+  bufMgr->clearBufStats();
+  double start = now();
+  for (int n = 0; n < numScans; n++)
+    for (int pageNo = 1; pageNo <= filePages; pageNo++)
+      for (int f = 0; f < numFiles; f++)
+	readAndCheck(files[f], names[f].c_str(), pageNo);
+  double elapsed = now() - start;
+  cout << "misses over " << numFiles << " files of " << filePages
+       << " pages, " << poolSize << " frames: "
+       << (long)(bufMgr->getBufStats().diskreads / elapsed)
+       << " misses/sec" << endl;
+  for (int f = 0; f < numFiles; f++)
+    dropFile(names[f].c_str(), files[f]);
+  delete bufMgr;
+  bufMgr = NULL;
+}
+
+
+//----------------------------------------------------------------------
+// Hit path: readPage/unPinPage against a PageHandle
+//----------------------------------------------------------------------
+
+static void benchHandles(const int numPages, const int numOps)
+{
+  const char* fileName = "bench.7";
+
+  bufMgr = new BufMgr(2 * numPages, 4);
+  File* file = makeFile(fileName, numPages);
+  cout << "hits on " << numPages << " cached pages" << endl;
+  for (int handles = 0; handles <= 1; handles++) {
+    unsigned int seed = 1;
+    bufMgr->clearBufStats();
+    double start = now();
+    for (int n = 0; n < numOps; n++) {
+      int pageNo = 1 + rand_r(&seed) % numPages;
+      if (handles) {
+	PageHandle handle;
+	CALL(bufMgr->readPage(file, pageNo, handle));
+      } else {
+	Page* page;
+	CALL(bufMgr->readPage(file, pageNo, page));
+	CALL(bufMgr->unPinPage(file, pageNo, false));
+      }
+    }
+    double elapsed = now() - start;
+    const BufStats stats = bufMgr->getBufStats();
+    cout << "  " << (handles ? "PageHandle" : "readPage/unPinPage") << ": "
+	 << (long)(numOps / elapsed) << " ops/sec, "
+	 << (double)stats.lookups / numOps << " hash probes per op" << endl;
+  }
+  dropFile(fileName, file);
+  delete bufMgr;
+  bufMgr = NULL;
+}
+
+
+//----------------------------------------------------------------------
+// File I/O: lseek+read, pread and scattered preadv from several threads
+//----------------------------------------------------------------------
+
+enum ReadMode { SEEKREAD, PREAD, PREADV };
+
+struct ReaderArgs
+{
+  ReadMode	  mode;
+  File*		  file;      // read through File (PREAD, PREADV)
+  int		  fd;        // read directly (SEEKREAD)
+  pthread_mutex_t* seekLatch; // keeps each lseek with its read (SEEKREAD)
+  const char*	  fileName;
+  int		  numPages;
+  int		  reads;     // pages to read
+  unsigned int	  seed;
+  long		  syscalls;  // system calls made
+  int		  errors;
+};
+
+static void* reader(void* arg)
+{
+  ReaderArgs* a = (ReaderArgs*)arg;
+  const int batch = 16;
+  Page pages[batch];
+  PageIO ios[batch];
+  char cmp[PAGESIZE];
+
+  for (int done = 0; done < a->reads; ) {
+    int n = a->mode == PREADV ? batch : 1;
+    if (a->mode == PREADV) {
+      // 16 distinct pages out of a window of 32, in page order
+      int window = 1 + rand_r(&a->seed) % (a->numPages - 2 * batch + 1);
+      int picked = 0;
+      for (int i = 0; i < 2 * batch && picked < batch; i++)
+	if (rand_r(&a->seed) % (2 * batch - i) < batch - picked) {
+	  ios[picked].pageNo = window + i;
+	  ios[picked].page = &pages[picked];
+	  if (picked == 0 || ios[picked - 1].pageNo + 1 != window + i)
+	    a->syscalls++;
+	  picked++;
+	}
+      if (a->file->readPages(ios, batch) != OK)
+	a->errors++;
+    } else {
+      ios[0].pageNo = 1 + rand_r(&a->seed) % a->numPages;
+      ios[0].page = &pages[0];
+      if (a->mode == PREAD) {
+	if (a->file->readPage(ios[0].pageNo, &pages[0]) != OK)
+	  a->errors++;
+	a->syscalls++;
+      } else {
+	pthread_mutex_lock(a->seekLatch);
+	if (lseek(a->fd, (off_t)ios[0].pageNo * sizeof(Page), SEEK_SET) < 0
+	    || read(a->fd, &pages[0], sizeof(Page)) != sizeof(Page))
+	  a->errors++;
+	pthread_mutex_unlock(a->seekLatch);
+	a->syscalls += 2;
+      }
+    }
+    for (int i = 0; i < n; i++) {
+      sprintf(cmp, "%s Page %lld", a->fileName, ios[i].pageNo);
+      if (memcmp(ios[i].page, cmp, strlen(cmp)) != 0)
+	a->errors++;
+    }
+    done += n;
+  }
+  return NULL;
+}
+
+static void benchFileIO(const int numPages, const int readsPerThread)
+{
+  const char* fileName = "bench.8";
+  static const char* modeNames[] = { "lseek+read", "pread", "preadv x16" };
+  pthread_mutex_t seekLatch;
+
+  bufMgr = new BufMgr(1024, 4);
+  File* file = makeFile(fileName, numPages);
+  CALL(bufMgr->flushFile(file));
+  int fd = open(fileName, O_RDONLY);
+  if (fd < 0) {
+    cerr << "cannot open " << fileName << endl;
+    cerr << "BENCHMARK FAILED" << endl;
+    exit(1);
+  }
+  pthread_mutex_init(&seekLatch, NULL);
+
+  cout << "file reads, " << numPages << " pages in file (page cache)" << endl;
+  for (int mode = SEEKREAD; mode <= PREADV; mode++) {
+    for (int numThreads = 1; numThreads <= 4; numThreads *= 4) {
+      pthread_t threads[4];
+      ReaderArgs args[4];
+      double start = now();
+      for (int t = 0; t < numThreads; t++) {
+	args[t].mode = (ReadMode)mode;
+	args[t].file = file;
+	args[t].fd = fd;
+	args[t].seekLatch = &seekLatch;
+	args[t].fileName = fileName;
+	args[t].numPages = numPages;
+	args[t].reads = readsPerThread;
+	args[t].seed = 31 * t + 7;
+	args[t].syscalls = 0;
+	args[t].errors = 0;
+	pthread_create(&threads[t], NULL, reader, &args[t]);
+      }
+      long syscalls = 0;
+      int errors = 0;
+      for (int t = 0; t < numThreads; t++) {
+	pthread_join(threads[t], NULL);
+	syscalls += args[t].syscalls;
+	errors += args[t].errors;
+      }
+      double elapsed = now() - start;
+      if (errors != 0) {
+	cerr << errors << " errors reading with " << modeNames[mode] << endl;
+	cerr << "BENCHMARK FAILED" << endl;
+	exit(1);
+      }
+      cout << "  " << modeNames[mode] << ", " << numThreads << " threads: "
+	   << (long)(numThreads * readsPerThread / elapsed) << " pages/sec, "
+	   << (double)syscalls / (numThreads * readsPerThread)
+	   << " syscalls/page" << endl;
+    }
+  }
+  pthread_mutex_destroy(&seekLatch);
+  close(fd);
+  dropFile(fileName, file);
+  delete bufMgr;
+  bufMgr = NULL;
+}
+
+
+//----------------------------------------------------------------------
+// File::allocatePage with the header written every change or lazily
+//----------------------------------------------------------------------
+
+static void benchAllocate(const int numPages)
+{
+  const char* fileName = "bench.9";
+  File* file;
+  pageno_t pageNo;
+
+  cout << "allocating " << numPages << " pages" << endl;
+  for (int lazy = 0; lazy <= 1; lazy++) {
+    struct stat statusBuf;
+    if (lstat(fileName, &statusBuf) == 0)
+      (void)db.destroyFile(fileName);
+    CALL(db.createFile(fileName));
+    CALL(db.openFile(fileName, file));
+    // a sync every change writes the header as often as it always was
+    file->setHeaderSync(lazy ? 0 : 1);
+    double start = now();
+    for (int i = 0; i < numPages; i++)
+      CALL(file->allocatePage(pageNo));
+    CALL(file->syncHeader());
+    double elapsed = now() - start;
+    if (pageNo != numPages) {
+      cerr << "last page allocated was " << pageNo << endl;
+      cerr << "BENCHMARK FAILED" << endl;
+      exit(1);
+    }
+    cout << "  header " << (lazy ? "written on flush" : "written every change")
+	 << ": " << (long)(numPages / elapsed) << " pages/sec, "
+	 << file->getHeaderIOSaved() << " header I/Os saved" << endl;
+    dropFile(fileName, file);
+  }
+}
+
+
+//----------------------------------------------------------------------
+// Bulk load: allocPage per page against allocPages per extent
+//----------------------------------------------------------------------
+
+static void benchBulkLoad(const int poolSize, const int numPages,
+			  const int extent)
+{
+  const char* fileName = "bench.10";
+  Page** pages = new Page* [extent];
+  Page* page;
+  File* file;
+  pageno_t pageNo;
+
+  cout << "bulk load of " << numPages << " pages, " << poolSize
+       << " frames" << endl;
+  bufMgr = new BufMgr(poolSize, 4);
+  for (int bulk = 0; bulk <= 1; bulk++) {
+    struct stat statusBuf;
+    if (lstat(fileName, &statusBuf) == 0)
+      (void)db.destroyFile(fileName);
+    CALL(db.createFile(fileName));
+    CALL(db.openFile(fileName, file));
+    bufMgr->clearBufStats();
+    double start = now();
+    if (bulk) {
+      for (int done = 0; done < numPages; done += extent) {
+	CALL(bufMgr->allocPages(file, extent, pageNo, pages));
+	for (int i = 0; i < extent; i++)
+	  sprintf((char*)pages[i], "%s Page %lld", fileName, pageNo + i);
+	CALL(bufMgr->unPinPages(file, pageNo, extent, true));
+      }
+    } else {
+      for (int done = 0; done < numPages; done++) {
+	CALL(bufMgr->allocPage(file, pageNo, page));
+	sprintf((char*)page, "%s Page %lld", fileName, pageNo);
+	CALL(bufMgr->unPinPage(file, pageNo, true));
+      }
+    }
+    CALL(bufMgr->flushFile(file));
+    double elapsed = now() - start;
+    const BufStats stats = bufMgr->getBufStats();
+    cout << "  " << (bulk ? "allocPages" : "allocPage") << ": "
+	 << (long)(numPages / elapsed) << " pages/sec, "
+	 << stats.diskreads << " pages read" << endl;
+    for (pageNo = 1; pageNo <= numPages; pageNo += 97)
+      readAndCheck(file, fileName, pageNo);
+    dropFile(fileName, file);
+  }
+  delete bufMgr;
+  bufMgr = NULL;
+  delete [] pages;
+}
+
+
+//----------------------------------------------------------------------
+// Disposing of and reallocating pages through the free-space map
+//----------------------------------------------------------------------
+
+static void benchFreeSpace(const int numPages, const int rounds)
+{
+  const char* fileName = "bench.11";
+  File* file;
+  pageno_t pageNo;
+
+  struct stat statusBuf;
+  if (lstat(fileName, &statusBuf) == 0)
+    (void)db.destroyFile(fileName);
+  CALL(db.createFile(fileName));
+  CALL(db.openFile(fileName, file));
+  CALL(file->allocatePages(numPages, pageNo));
+  // the first page freed in each range of the map becomes its map page
+  CALL(file->disposePage(2));
+  for (int k = 1; k * MAPBITS < numPages; k++)
+    CALL(file->disposePage(k * MAPBITS));
+
+  // free every other page, then take them all back
+  double disposeTime = 0, allocTime = 0;
+  for (int n = 0; n < rounds; n++) {
+    double start = now();
+    for (int i = 3; i < numPages; i += 2)
+      CALL(file->disposePage(i));
+    disposeTime += now() - start;
+    start = now();
+    for (int i = 3; i < numPages; i += 2)
+      CALL(file->allocatePage(pageNo));
+    allocTime += now() - start;
+  }
+  CALL(file->syncHeader());
+  int ops = rounds * (numPages / 2 - 1);
+  cout << "free-space map, " << numPages << " pages: "
+       << (long)(ops / disposeTime) << " disposes/sec, "
+       << (long)(ops / allocTime) << " allocations/sec" << endl;
+
+  // a freed run is found again even behind scattered free pages
+  for (int i = 11; i < numPages / 2; i += 4)
+    CALL(file->disposePage(i));
+  const int run = numPages / 2 + 100;
+  for (int i = run; i < run + 32; i++)
+    CALL(file->disposePage(i));
+  CALL(file->allocatePages(32, pageNo));
+  if (pageNo != run) {
+    cerr << "32-page run allocated at " << pageNo << endl;
+    cerr << "BENCHMARK FAILED" << endl;
+    exit(1);
+  }
+  dropFile(fileName, file);
+}
+
+
+//----------------------------------------------------------------------
+// Reads through the pool against reads in place from a mapping
+//----------------------------------------------------------------------
+
+static void benchMapped(const int poolSize, const int numPages,
+			const int numOps, const int numScans)
+{
+  const char* fileName = "bench.12";
+
+  cout << "random and sequential reads, " << poolSize << " frames, "
+       << numPages << " pages in file" << endl;
+  bufMgr = new BufMgr(poolSize, 4);
+  File* file = makeFile(fileName, numPages);
+  CALL(db.closeFile(file));
+  for (int mapped = 0; mapped <= 1; mapped++) {
+    CALL(db.openFile(fileName, file, mapped));
+    unsigned int seed = 5;
+    double start = now();
+    for (int n = 0; n < numOps; n++)
+      readAndCheck(file, fileName, 1 + rand_r(&seed) % numPages);
+    double random = now() - start;
+    start = now();
+    for (int n = 0; n < numScans; n++)
+      for (int pageNo = 1; pageNo <= numPages; pageNo++)
+	readAndCheck(file, fileName, pageNo);
+    double sequential = now() - start;
+    cout << "  " << (mapped ? "mapped" : "copied") << ": "
+	 << (long)(numOps / random) << " random reads/sec, "
+	 << (long)(numScans * numPages / sequential)
+	 << " sequential reads/sec" << endl;
+    CALL(db.closeFile(file));
+  }
+  CALL(db.destroyFile(fileName));
+  delete bufMgr;
+  bufMgr = NULL;
+}
+
+
+//----------------------------------------------------------------------
+// I/O backends: scattered batch reads from a cold page cache
+//----------------------------------------------------------------------
+
+static void benchBackends(const int numPages, const int batch,
+			  const int numBatches)
+{
+  const char* fileName = "bench.13";
+  static const IOKind kinds[] = { SYNCIO, THREADIO, URINGIO };
+  Page* pages = new Page [batch];
+  PageIO* ios = new PageIO [batch];
+  char cmp[PAGESIZE];
+
+  bufMgr = new BufMgr(1024, 4);
+  File* file = makeFile(fileName, numPages);
+  CALL(bufMgr->flushFile(file));
+  int fd = open(fileName, O_RDONLY);
+
+  cout << "batches of " << batch << " random pages of " << numPages
+       << ", page cache dropped before each batch" << endl;
+  for (int k = 0; k < 3; k++) {
+    if (IOBackend::select(kinds[k], batch) != OK) {
+      cout << "  backend " << k << " is not available" << endl;
+      continue;
+    }
+    unsigned int seed = 3;
+    double elapsed = 0;
+    for (int n = 0; n < numBatches; n++) {
+      if (fd >= 0)
+	(void)posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+      // one page from each batch-th of the file, in ascending order
+      const int stride = numPages / batch;
+      for (int i = 0; i < batch; i++) {
+	ios[i].pageNo = 1 + i * stride + rand_r(&seed) % stride;
+	ios[i].page = &pages[i];
+      }
+      double start = now();
+      CALL(file->readPages(ios, batch));
+      elapsed += now() - start;
+      for (int i = 0; i < batch; i++) {
+	sprintf(cmp, "%s Page %lld", fileName, ios[i].pageNo);
+	if (memcmp(ios[i].page, cmp, strlen(cmp)) != 0) {
+	  cerr << "page " << ios[i].pageNo << " is corrupt" << endl;
+	  cerr << "BENCHMARK FAILED" << endl;
+	  exit(1);
+	}
+      }
+    }
+    cout << "  " << IOBackend::get()->name() << ": "
+	 << (long)(numBatches * batch / elapsed) << " pages/sec" << endl;
+  }
+  CALL(IOBackend::select(SYNCIO));
+  if (fd >= 0)
+    close(fd);
+  dropFile(fileName, file);
+  delete bufMgr;
+  bufMgr = NULL;
+  delete [] pages;
+  delete [] ios;
+}
+
+
+//----------------------------------------------------------------------
+// O_DIRECT: scans of a file larger than the pool, through the kernel's
+// page cache and around it
+//----------------------------------------------------------------------
+
+static void benchDirect(const int bufs, const int numPages, const int scans)
+{
+  const char* fileName = "bench.14";
+  static const int modes[] = { BUFFERED, DIRECT, DIRECT };
+  static const bool huge[] = { false, false, true };
+  static const char* names[] = { "buffered", "direct", "direct, huge pool" };
+
+  cout << scans << " scans of " << numPages << " pages through " << bufs
+       << " frames" << endl;
+  for (int k = 0; k < 3; k++) {
+    bufMgr = new BufMgr(bufs, 4, CLOCK, huge[k]);
+    File* file = makeFile(fileName, numPages);
+    CALL(db.closeFile(file));
+    Status status = db.openFile(fileName, file, modes[k]);
+    if (status != OK) {
+      cout << "  " << names[k] << ": cannot open, skipped" << endl;
+      CALL(db.destroyFile(fileName));
+      delete bufMgr;
+      bufMgr = NULL;
+      continue;
+    }
+
+    double start = now();
+    for (int n = 0; n < scans; n++)
+      for (int i = 1; i <= numPages; i++)
+	readAndCheck(file, fileName, i);
+    double elapsed = now() - start;
+
+    cout << "  " << names[k] << (huge[k] && !bufMgr->hugePool() ?
+				 " (no huge pages reserved)" : "")
+	 << ": " << (long)(scans * numPages / elapsed) << " pages/sec" << endl;
+    dropFile(fileName, file);
+    delete bufMgr;
+    bufMgr = NULL;
+  }
+}
+
+
+//----------------------------------------------------------------------
+// Disk space after a large delete: punched holes, then compact()
+//----------------------------------------------------------------------
+
+// bytes allocated on disk, or the file's length if size is set
+static long diskBytes(const char* fileName, const bool size = false)
+{
+  struct stat statusBuf;
+  if (stat(fileName, &statusBuf) < 0)
+    return -1;
+  return size ? (long)statusBuf.st_size : (long)statusBuf.st_blocks * 512;
+}
+
+static void benchReclaim(const int numPages)
+{
+  const char* fileName = "bench.15";
+
+  bufMgr = new BufMgr(1024, 4);
+  File* file = makeFile(fileName, numPages);
+  CALL(bufMgr->flushFile(file));
+  long loaded = diskBytes(fileName);
+
+  // delete every page but one in eight, then the whole second half
+  double start = now();
+  int disposed = 0;
+  for (pageno_t pageNo = 2; pageNo <= numPages / 2; pageNo++)
+    if (pageNo % 8 != 0) {
+      CALL(bufMgr->disposePage(file, pageNo));
+      disposed++;
+    }
+  for (pageno_t pageNo = numPages / 2 + 1; pageNo <= numPages; pageNo++) {
+    CALL(bufMgr->disposePage(file, pageNo));
+    disposed++;
+  }
+  double elapsed = now() - start;
+  CALL(file->syncHeader());
+  long punched = diskBytes(fileName);
+  long length = diskBytes(fileName, true);
+  CALL(file->compact());
+  long compacted = diskBytes(fileName);
+
+  cout << "disposing of " << disposed << " of " << numPages << " pages: "
+       << (long)(disposed / elapsed) << " pages/sec" << endl;
+  cout << "  on disk: " << loaded / 1024 << "K loaded, "
+       << punched / 1024 << "K after dispose, "
+       << compacted / 1024 << "K after compact" << endl;
+  cout << "  length: " << length / 1024 << "K before compact, "
+       << diskBytes(fileName, true) / 1024 << "K after" << endl;
+  for (pageno_t pageNo = 8; pageNo <= numPages / 2; pageNo += 8)
+    readAndCheck(file, fileName, pageNo);
+  dropFile(fileName, file);
+  delete bufMgr;
+  bufMgr = NULL;
+}
+
+
+//----------------------------------------------------------------------
+// Record churn on one page: delete a random record, insert another
+//----------------------------------------------------------------------
+
+static void benchChurn(const int recLen, const int ops)
+{
+  Page page;
+  char rec[64];
+  Record record = { rec, recLen };
+  vector<RID> rids;
+  RID rid;
+
+  memset(rec, 'r', sizeof rec);
+  page.init(1);
+  while (page.insertRecord(record, rid) == OK)
+    rids.push_back(rid);
+  // leave a third of the slots free, scattered over the slot array
+  unsigned int seed = 11;
+  for (int i = 0; i < (int)rids.size() / 3; i++) {
+    int victim = rand_r(&seed) % rids.size();
+    if (page.deleteRecord(rids[victim]) == OK)
+      rids.erase(rids.begin() + victim);
+  }
+
+  double start = now();
+  for (int i = 0; i < ops; i++) {
+    int victim = rand_r(&seed) % rids.size();
+    CALL(page.deleteRecord(rids[victim]));
+    CALL(page.insertRecord(record, rids[victim]));
+  }
+  double elapsed = now() - start;
+  cout << "delete/insert churn of " << recLen << " byte records, "
+       << rids.size() << " live on a " << PAGESIZE << " byte page: "
+       << (long)(ops / elapsed) << " pairs/sec" << endl;
+
+  // empty full pages in random order
+  long deletes = 0;
+  elapsed = 0;
+  while (deletes < ops) {
+    page.init(1);
+    rids.clear();
+    while (page.insertRecord(record, rid) == OK)
+      rids.push_back(rid);
+    for (int i = rids.size() - 1; i > 0; i--)
+      swap(rids[i], rids[rand_r(&seed) % (i + 1)]);
+    start = now();
+    for (int i = 0; i < (int)rids.size(); i++)
+      CALL(page.deleteRecord(rids[i]));
+    elapsed += now() - start;
+    deletes += rids.size();
+  }
+  cout << "emptying " << rids.size() << " record pages: "
+       << (long)(deletes / elapsed) << " deletes/sec" << endl;
+}
+
+
+//----------------------------------------------------------------------
+// Scanning one page with holes in its slot array: firstRecord/nextRecord
+// plus getRecord for each record, against getRecords batches
+//----------------------------------------------------------------------
+
+static void benchPageScan(const int recLen, const int scans)
+{
+  Page page;
+  char rec[64];
+  Record record = { rec, recLen };
+  RID rid, nextRid;
+  int slots = 0;
+
+  memset(rec, 's', sizeof rec);
+  page.init(1);
+  while (page.insertRecord(record, rid) == OK)
+    slots++;
+  for (rid.slotNo = 0; rid.slotNo < slots - 1; rid.slotNo++)
+    if (rid.slotNo % 3 == 1 || rid.slotNo % 16 > 12)
+      CALL(page.deleteRecord(rid));
+
+  long records = 0, bytes = 0;
+  double start = now();
+  for (int i = 0; i < scans; i++) {
+    Status status = page.firstRecord(rid);
+    while (status == OK) {
+      CALL(page.getRecord(rid, record));
+      records++;
+      bytes += record.length;
+      status = page.nextRecord(rid, nextRid);
+      rid = nextRid;
+    }
+  }
+  double elapsed = now() - start;
+  cout << "scanning " << records / scans << " of " << slots
+       << " slots on a " << PAGESIZE << " byte page: "
+       << (long)(records / elapsed) << " records/sec one at a time, ";
+
+  PageRecord recs[64];
+  long batched = 0, batchedBytes = 0;
+  start = now();
+  for (int i = 0; i < scans; i++) {
+    int slotNo = 0, count;
+    while (page.getRecords(slotNo, recs, 64, count) == OK)
+      for (int k = 0; k < count; k++) {
+        batched++;
+        batchedBytes += recs[k].length;
+      }
+  }
+  elapsed = now() - start;
+  cout << (long)(batched / elapsed) << " batched" << endl;
+  if (batched != records || batchedBytes != bytes) {
+    cerr << "batched scan saw " << batched << " records, expected "
+         << records << endl;
+    exit(1);
+  }
+}
+
+
+//----------------------------------------------------------------------
+// Sequential scans of a heap file larger than the pool, with and without
+// reading ahead along the page chain.  The file is held open DIRECT, so
+// that the pages come from the device rather than the kernel's cache.
+//----------------------------------------------------------------------
+
+static void benchHeapScan(const int poolSize, const int numRecs,
+			  const int recLen, const int numScans)
+{
+  const char* fileName = "bench.16";
+  char buf[64];
+  Record rec = { buf, recLen };
+  RID rid;
+  Status status;
+
+  bufMgr = new BufMgr(poolSize, 4);
+  CALL(createHeapFile(fileName));
+  HeapFile* heap = new HeapFile(fileName, status);
+  CALL(status);
+  memset(buf, ' ', sizeof buf);
+  for (int i = 0; i < numRecs; i++) {
+    sprintf(buf, "%d", i);
+    CALL(heap->insertRecord(rec, rid));
+  }
+  delete heap;
+  delete bufMgr;
+
+  cout << "heap file scans, " << poolSize << " frames, " << numRecs
+       << " records of " << recLen << " bytes" << endl;
+  for (int window = 0; window <= 32; window += 32) {
+    bufMgr = new BufMgr(poolSize, 4);
+    File* file;
+    bool direct = db.openFile(fileName, file, DIRECT) == OK;
+    HeapFileScan* scan = new HeapFileScan(fileName, status, window);
+    CALL(status);
+
+    double start = now();
+    for (int n = 0; n < numScans; n++) {
+      long count = 0, sum = 0;
+      CALL(scan->startScan());
+      while ((status = scan->scanNext(rid, rec)) == OK) {
+	count++;
+	sum += atoi((char*)rec.data);
+      }
+      if (status != FILEEOF || count != numRecs
+	  || sum != (long)numRecs * (numRecs - 1) / 2) {
+	cerr << "heap file scan saw " << count << " records" << endl;
+	exit(1);
+      }
+      CALL(scan->endScan());
+    }
+    double elapsed = now() - start;
+
+    cout << "  " << (window ? "with" : "without") << " readahead"
+	 << (direct ? "" : " (buffered)") << ": "
+	 << (long)(numScans * numRecs / elapsed) << " records/sec" << endl;
+    delete scan;
+    if (direct)
+      CALL(db.closeFile(file));
+    delete bufMgr;
+    bufMgr = NULL;
+  }
+  bufMgr = new BufMgr(poolSize, 4);
+  CALL(destroyHeapFile(fileName));
+  delete bufMgr;
+  bufMgr = NULL;
+}
+
+
+//----------------------------------------------------------------------
+// Inserts into a heap file half emptied by random deletes: the space map
+// steers them to the pages with room
+//----------------------------------------------------------------------
+
+static void benchHeapRefill(const int poolSize, const int numRecs,
+			    const int recLen)
+{
+  const char* fileName = "bench.17";
+  char buf[64];
+  Record rec = { buf, recLen };
+  vector<RID> rids(numRecs);
+  Status status;
+
+  bufMgr = new BufMgr(poolSize, 4);
+  CALL(createHeapFile(fileName));
+  HeapFile* heap = new HeapFile(fileName, status);
+  CALL(status);
+  memset(buf, 'h', sizeof buf);
+  for (int i = 0; i < numRecs; i++)
+    CALL(heap->insertRecord(rec, rids[i]));
+  long before = diskBytes(fileName, true) / PAGESIZE;
+
+  unsigned int seed = 17;
+  for (int i = numRecs - 1; i > 0; i--)
+    swap(rids[i], rids[rand_r(&seed) % (i + 1)]);
+  for (int i = 0; i < numRecs / 2; i++)
+    CALL(heap->deleteRecord(rids[i]));
+
+  double start = now();
+  for (int i = 0; i < numRecs / 2; i++)
+    CALL(heap->insertRecord(rec, rids[i]));
+  double elapsed = now() - start;
+  if (heap->getRecCnt() != numRecs) {
+    cerr << "heap file has " << heap->getRecCnt() << " records" << endl;
+    exit(1);
+  }
+  delete heap;
+  cout << "refilling " << numRecs / 2 << " of " << numRecs << " records of "
+       << recLen << " bytes: " << (long)(numRecs / 2 / elapsed)
+       << " inserts/sec, file " << before << " -> "
+       << diskBytes(fileName, true) / PAGESIZE << " pages" << endl;
+  CALL(destroyHeapFile(fileName));
+  delete bufMgr;
+  bufMgr = NULL;
+}
+
+
+int main()
+{
+  // all pages resident: pure hit path
+  benchThreads(1024, 1, 512, 200000);
+  benchThreads(1024, 16, 512, 200000);
+  // file twice the pool: hits mixed with misses and evictions
+  benchThreads(1024, 16, 2048, 50000);
+  benchThreads(1024, 16, 2048, 50000, ARC);
+
+  benchHashTables();
+
+  benchPolicies(256, 128, 4096, 150000);
+
+  benchWriter(256, 1024, 100000);
+
+  benchReadAhead(256, 8192, 4);
+
+  benchBatches(1024, 8192, 32, 4);
+
+  benchFlush(65536, 16, 2000);
+
+  benchMisses(1024, 8, 1024, 10);
+
+  benchHandles(4096, 2000000);
+
+  benchFileIO(4096, 200000);
+
+  benchAllocate(10000);
+
+  benchBulkLoad(1024, 16384, 256);
+
+  benchFreeSpace(16384, 20);
+
+  benchMapped(1024, 16384, 500000, 10);
+
+  benchBackends(65536, 32, 200);
+
+  benchDirect(1024, 16384, 4);
+
+  benchReclaim(65536);
+
+  benchChurn(8, 1000000);
+
+  benchPageScan(8, 100000);
+
+  benchHeapScan(256, 500000, 32, 4);
+
+  benchHeapRefill(256, 200000, 32);
+
+  cout << endl << "Benchmarks done." << endl;
+  return 0;
+}
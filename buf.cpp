@@ -19,9 +19,14 @@
 #include <fcntl.h>
 #include <iostream>
 #include <stdio.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <new>
 #include "page.h"
 #include "buf.h"
+#include "replacer.h"
 #include <vector>
+#include <algorithm>
 
 #define ASSERT(c)  { if (!(c)) { \
 		       cerr << "At line " << __LINE__ << ":" << endl << "  "; \
@@ -35,13 +40,37 @@
                         } \
                       }
 
+// Holds a shard latch for as long as the object lives, so that every
+// return path out of a BufMgr method releases it.
+class ShardLatch
+{
+public:
+  ShardLatch(BufShard& s) : shard(s) { pthread_mutex_lock(&shard.latch); }
+  ~ShardLatch() { pthread_mutex_unlock(&shard.latch); }
+private:
+  BufShard& shard;
+};
+
+// most pages the prefetch thread reads in one batch
+static const int maxPrefetchBatch = 64;
+
+// orders the pages of a batch so that adjacent ones form runs
+static bool pageOrder(const PageIO& a, const PageIO& b)
+{
+  return a.pageNo < b.pageNo;
+}
+
 //----------------------------------------
 // Constructor of the class BufMgr
 //----------------------------------------
 
-BufMgr::BufMgr(const int bufs)
+BufMgr::BufMgr(const int bufs, const int nshards, const Replacement policy,
+               const bool hugePages)
 {
     numBufs = bufs;
+    numShards = nshards;
+    if (numShards < 1) numShards = 1;
+    if (numShards > numBufs) numShards = numBufs;
 
     bufTable = new BufDesc[bufs];
     memset(bufTable, 0, bufs * sizeof(BufDesc));
@@ -51,13 +80,73 @@ BufMgr::BufMgr(const int bufs)
         bufTable[i].valid = false;
     }
 
-    bufPool = new Page[bufs];
-    memset(bufPool, 0, bufs * sizeof(Page));
+    // map the pool rather than new it: the frames come out zeroed and
+    // aligned to the system page, which is what O_DIRECT wants.  Huge
+    // pages are tried first if asked for, falling back to asking for
+    // transparent ones.
+    const size_t hugeSize = 2 * 1024 * 1024;
+    poolBytes = (size_t)bufs * sizeof(Page);
+    poolHuge = false;
+    void* pool = MAP_FAILED;
+    if (hugePages)
+    {
+        size_t rounded = (poolBytes + hugeSize - 1) / hugeSize * hugeSize;
+        pool = mmap(NULL, rounded, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (pool != MAP_FAILED)
+        {
+            poolBytes = rounded;
+            poolHuge = true;
+        }
+    }
+    if (pool == MAP_FAILED)
+    {
+        pool = mmap(NULL, poolBytes, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (pool == MAP_FAILED)
+            throw std::bad_alloc();
+        if (hugePages)
+            (void)madvise(pool, poolBytes, MADV_HUGEPAGE);
+    }
+    bufPool = (Page*)pool;
+
+    // hand out the frames in contiguous ranges, spreading the remainder
+    // over the first shards
+    shards = new BufShard[numShards];
+    int first = 0;
+    for (int i = 0; i < numShards; i++)
+    {
+        BufShard& shard = shards[i];
+        pthread_mutex_init(&shard.latch, NULL);
+        pthread_cond_init(&shard.readDone, NULL);
+        shard.firstFrame = first;
+        shard.numFrames = bufs / numShards + (i < bufs % numShards ? 1 : 0);
+        first += shard.numFrames;
+
+        // allocate the shard's hash tables, with room for a list head per file
+        shard.hashTable = new BufHashTbl (2 * shard.numFrames);
+        shard.mappedPins = new BufHashTbl (2 * shard.numFrames);
+        shard.replacer = Replacer::create(policy, bufTable + shard.firstFrame,
+                                          shard.numFrames);
+
+        // every frame starts out empty; hand out low frame numbers first
+        for (int f = shard.numFrames - 1; f >= 0; f--)
+            shard.freeFrames.push_back(f);
+        shard.numUnpinned = shard.numFrames;
+    }
 
-    int htsize = ((((int) (bufs * 1.2))*2)/2)+1;
-    hashTable = new BufHashTbl (htsize);  // allocate the buffer hash table
+    writerRunning = false;
+    pthread_mutex_init(&writerLock, NULL);
+    pthread_cond_init(&writerWake, NULL);
+    pthread_cond_init(&writeDone, NULL);
 
-    clockHand = bufs - 1;
+    prefetcherRunning = false;
+    prefetcherStop = false;
+    maxReadAhead = 0;
+    prefetchInFlight = NULL;
+    pthread_mutex_init(&prefetchLock, NULL);
+    pthread_cond_init(&prefetchWake, NULL);
+    pthread_cond_init(&prefetchIdle, NULL);
 }
 
 /**
@@ -65,6 +154,14 @@ BufMgr::BufMgr(const int bufs)
  */
 BufMgr::~BufMgr() 
 {
+  stopWriter();
+  if(prefetcherRunning){
+    pthread_mutex_lock(&prefetchLock);
+    prefetcherStop = true;
+    pthread_cond_signal(&prefetchWake);
+    pthread_mutex_unlock(&prefetchLock);
+    pthread_join(prefetcher, NULL);
+  }
   // flush pages inside the buffer pool if necessary
   for(int i = 0; i < numBufs; i++){
     BufDesc* frame = &bufTable[i];
@@ -75,66 +172,217 @@ BufMgr::~BufMgr()
     }
   }
   // clean the allocated memory
+  for(int i = 0; i < numShards; i++){
+    delete shards[i].hashTable;
+    delete shards[i].mappedPins;
+    delete shards[i].replacer;
+    pthread_mutex_destroy(&shards[i].latch);
+    pthread_cond_destroy(&shards[i].readDone);
+  }
+  delete[] shards;
+  pthread_mutex_destroy(&writerLock);
+  pthread_cond_destroy(&writerWake);
+  pthread_cond_destroy(&writeDone);
+  pthread_mutex_destroy(&prefetchLock);
+  pthread_cond_destroy(&prefetchWake);
+  pthread_cond_destroy(&prefetchIdle);
   delete[] bufTable;
-  delete[] bufPool;
-  delete hashTable;
+  munmap(bufPool, poolBytes);
 }
 
 
 /**
- * Allocates a free frame using the clock algorithm; if necessary, writing a dirty page back to disk.
+ * Picks the shard responsible for caching a page. The file pointer and page
+ * number are mixed so that consecutive pages of one file land in different shards.
+ * @param file the pointer to the file
+ * @param pageNo the index of page inside the file
+ * @return the shard that caches (file, pageNo)
+ */
+BufShard& BufMgr::shardOf(const File* file, const pageno_t pageNo) const
+{
+  return shards[hashPage(file, pageNo) % numShards];
+}
+
+
+/**
+ * Allocates a free frame of a shard for (file, pageNo). An empty frame is taken from the free list if there is one,
+ * otherwise the shard's replacement policy picks a victim; if necessary, its dirty page is written back to disk.
+ * The count of unpinned frames tells in O(1) whether there is any frame to be had.
+ * The caller must hold the shard latch.
+ * @param shard the shard to take the frame from
+ * @param file the pointer to the file the frame is wanted for
+ * @param pageNo the index of the page the frame is wanted for
  * @param frame the addres where index of frame to be allocated has stored
  * @return OK on success
- * @return BUFFEREXCEEDED if all buffer frames are pinned
+ * @return BUFFEREXCEEDED if all buffer frames of the shard are pinned
  * @return UNIXERR if the call to the I/O layer returned an error when a dirty page was being written to disk 
  */
-const Status BufMgr::allocBuf(int & frame) 
+const Status BufMgr::allocBuf(BufShard& shard, const File* file, const pageno_t pageNo,
+			      int & frame) 
 {
-  // first check if all pinned
-  bool unpinned = false;
-  for(int i = 0; i < numBufs; i++){
-    if(bufTable[i].pinCnt <= 0){
-      // found an unpinned frame
-      unpinned = true;
-      break;
+  if(shard.numUnpinned <= 0) return BUFFEREXCEEDED;
+  BufDesc* table = bufTable + shard.firstFrame;
+  int victim;
+  if(!shard.freeFrames.empty()){
+    victim = shard.freeFrames.back();
+    shard.freeFrames.pop_back();
+  } else {
+    victim = shard.replacer->victim(file, pageNo);
+    if(victim < 0) return BUFFEREXCEEDED;
+    BufDesc* frameInfo = &table[victim];
+    if(frameInfo->dirty){
+      // flush page to disk
+      Status s = frameInfo->file->writePage(frameInfo->pageNo, bufPool + frameInfo->frameNo);
+      CHKSTAT(s); // UNIXERR
+      shard.stats.diskwrites++;
+      shard.stats.fgwrites++;
     }
+    unmapPage(shard, frameInfo->file, frameInfo->pageNo, frameInfo->frameNo);
+    shard.replacer->evicted(victim);
   }
-  if(unpinned == false) return BUFFEREXCEEDED;
-  //unsigned int startHand = clockHand;
-  while(true){
-    advanceClock();
-    BufDesc* frameInfo = &bufTable[clockHand];
-    if(frameInfo->valid){
-      if(frameInfo->refbit){
-	frameInfo->refbit = false;
-	continue;
-      } else {
-	if(frameInfo->pinCnt > 0){
-	  continue;
-	} else {
-	  if(frameInfo->dirty){
-	    // flush page to disk
-	    Status s = frameInfo->file->writePage(frameInfo->pageNo, bufPool + frameInfo->frameNo);
-	    CHKSTAT(s); // UNIXERR
-	  }
-	  break;
-	}
-      }
-    } else {
-      break;
+  // set frame
+  table[victim].Clear();
+  frame = table[victim].frameNo;
+  return OK;
+}
+
+/**
+ * Allocates a frame of a shard for a page read through a scan ring. Until the ring has its share of the
+ * shard's frames it takes them from allocBuf; after that it recycles its own frames in turn, unless the
+ * frame is pinned or someone else has used its page, in which case the frame is left to the pool and
+ * replaced in the ring by one from allocBuf. The caller must hold the shard latch.
+ * @param shard the shard to take the frame from
+ * @param ring the ring of the scan
+ * @param file the pointer to the file the frame is wanted for
+ * @param pageNo the index of the page the frame is wanted for
+ * @param frame the addres where index of frame to be allocated has stored
+ * @return the same as allocBuf
+ */
+const Status BufMgr::ringBuf(BufShard& shard, BufRing& ring, const File* file,
+			     const pageno_t pageNo, int& frame)
+{
+  std::vector<int>& slots = ring.frames[&shard - shards];
+  int& next = ring.next[&shard - shards];
+  Status s;
+  if((int)slots.size() < ring.perShard){
+    s = allocBuf(shard, file, pageNo, frame);
+    CHKSTAT(s); // BUFFEREXCEEDED, UNIXERR
+    slots.push_back(frame);
+    return OK;
+  }
+  BufDesc* frameInfo = &bufTable[slots[next]];
+  if(frameInfo->valid && frameInfo->scanOnly && frameInfo->pinCnt == 0){
+    if(frameInfo->dirty){
+      s = frameInfo->file->writePage(frameInfo->pageNo, bufPool + frameInfo->frameNo);
+      CHKSTAT(s); // UNIXERR
+      shard.stats.diskwrites++;
+      shard.stats.fgwrites++;
     }
+    unmapPage(shard, frameInfo->file, frameInfo->pageNo, frameInfo->frameNo);
+    shard.replacer->dropped(frameInfo->frameNo - shard.firstFrame);
+    frameInfo->Clear();
+    frame = frameInfo->frameNo;
+  } else {
+    s = allocBuf(shard, file, pageNo, frame);
+    CHKSTAT(s); // BUFFEREXCEEDED, UNIXERR
+    slots[next] = frame;
   }
-  // set frame
-  if(bufTable[clockHand].valid){
-    hashTable->remove(bufTable[clockHand].file, bufTable[clockHand].pageNo);
+  next = (next + 1) % slots.size();
+  return OK;
+}
+
+/**
+ * Looks a page up in a shard's hash table, counting the probe in the shard's statistics. If the page
+ * is still being read in by the readPage that missed it, waits for the read to end and looks again,
+ * so that callers only ever see a page that is in its frame. The reader needs no other latch to end
+ * its read, so the caller may hold the latches of other shards meanwhile.
+ * The caller must hold the shard latch.
+ * @param shard the shard that would cache the page
+ * @param file the pointer to the file
+ * @param pageNo the index of the page inside the file
+ * @param frame set to the index of the frame holding the page, if found
+ * @return OK if the page is in the pool
+ * @return HASHNOTFOUND otherwise
+ */
+const Status BufMgr::findPage(BufShard& shard, const File* file, const pageno_t pageNo, int& frame)
+{
+  if(pageNo == FILEFRAMES) return HASHNOTFOUND;
+  shard.stats.lookups++;
+  Status s;
+  while((s = shard.hashTable->lookup(file, pageNo, frame)) == OK && bufTable[frame].reading)
+    pthread_cond_wait(&shard.readDone, &shard.latch);
+  return s;
+}
+
+/**
+ * Enters a page into a shard's hash table and links its frame into the list of the file's frames,
+ * right after the first one; the hash table holds the first under (file, FILEFRAMES).
+ * The caller must hold the shard latch.
+ * @param shard the shard caching the page
+ * @param file the pointer to the file
+ * @param pageNo the index of the page inside the file
+ * @param frame the index of the frame holding the page
+ * @return OK if no errors occurred
+ * @return HASHTBLERROR if the page was already in the hash table
+ */
+const Status BufMgr::mapPage(BufShard& shard, const File* file, const pageno_t pageNo, const int frame)
+{
+  Status s = shard.hashTable->insert(file, pageNo, frame);
+  CHKSTAT(s); // HASHTBLERROR
+  BufDesc* desc = &bufTable[frame];
+  int first;
+  if(shard.hashTable->lookup(file, FILEFRAMES, first) == OK){
+    desc->filePrev = first;
+    desc->fileNext = bufTable[first].fileNext;
+    if(desc->fileNext >= 0) bufTable[desc->fileNext].filePrev = frame;
+    bufTable[first].fileNext = frame;
+  } else {
+    desc->filePrev = desc->fileNext = -1;
+    s = shard.hashTable->insert(file, FILEFRAMES, frame);
+    if(s != OK){
+      shard.hashTable->remove(file, pageNo);
+      return s; // HASHTBLERROR
+    }
   }
-  bufTable[clockHand].Clear();
-  frame = bufTable[clockHand].frameNo;
   return OK;
 }
 
 /**
- * Read a page. First check if its in a buffer pool
+ * Removes a page from a shard's hash table and unlinks its frame from the list of the file's frames.
+ * The caller must hold the shard latch.
+ * @param shard the shard caching the page
+ * @param file the pointer to the file
+ * @param pageNo the index of the page inside the file
+ * @param frame the index of the frame holding the page
+ * @return OK if no errors occurred
+ * @return HASHTBLERROR if the page was not in the hash table
+ */
+const Status BufMgr::unmapPage(BufShard& shard, const File* file, const pageno_t pageNo, const int frame)
+{
+  Status s = shard.hashTable->remove(file, pageNo);
+  CHKSTAT(s); // HASHTBLERROR
+  BufDesc* desc = &bufTable[frame];
+  if(desc->fileNext >= 0) bufTable[desc->fileNext].filePrev = desc->filePrev;
+  if(desc->filePrev >= 0) bufTable[desc->filePrev].fileNext = desc->fileNext;
+  else if(desc->fileNext >= 0) shard.hashTable->update(file, FILEFRAMES, desc->fileNext);
+  else shard.hashTable->remove(file, FILEFRAMES);
+  return OK;
+}
+
+/**
+ * Puts a frame that holds no page (any more) back on its shard's free list.
+ * The caller must hold the shard latch and have cleared the frame.
+ * @param shard the shard owning the frame
+ * @param frame the index of the frame in bufTable
+ */
+const void BufMgr::releaseBuf(BufShard& shard, int frame)
+{
+  shard.freeFrames.push_back(frame - shard.firstFrame);
+}
+
+/**
+ * Read a page. A page of a mapped file is handed out in place from the mapping;
+ * otherwise first check if its in a buffer pool
  * @param file the pointer to the file
  * @param PageNo the index of page inside the file
  * @param page the reference of the pointer pointing to the address where page to be stored
@@ -143,27 +391,106 @@ const Status BufMgr::allocBuf(int & frame)
  * @reutrn BUFFEREXCEEDED if all buffer frames are pinned
  * @return HASHTBLERROR if a hash table error occured
  */	
-const Status BufMgr::readPage(File* file, const int PageNo, Page*& page) 
+const Status BufMgr::readPage(File* file, const pageno_t PageNo, Page*& page) 
+{
+  Page* mapped = file->mappedPage(PageNo);
+  if(mapped){
+    page = mapped;
+    return pinMapped(file, PageNo, mapped);
+  }
+  Status s = pinPage(file, PageNo, page);
+  if(s == OK && maxReadAhead > 0) noteAccess(file, PageNo);
+  return s;
+}
+
+/**
+ * Read a page for a bulk scan. A miss recycles a frame of the scan's ring rather than asking the replacement
+ * policy for one, and the page is never marked as recently referenced. Readahead is not triggered.
+ * @param file the pointer to the file
+ * @param PageNo the index of page inside the file
+ * @param page the reference of the pointer pointing to the address where page to be stored
+ * @param ring the ring of frames of the scan
+ * @return the same as readPage
+ */
+const Status BufMgr::readPage(File* file, const pageno_t PageNo, Page*& page, BufRing& ring) 
+{
+  if((int)ring.frames.size() != numShards){
+    ring.perShard = (ring.size + numShards - 1) / numShards;
+    if(ring.perShard < 1) ring.perShard = 1;
+    ring.frames.assign(numShards, std::vector<int>());
+    ring.next.assign(numShards, 0);
+  }
+  Page* mapped = file->mappedPage(PageNo);
+  if(mapped){
+    page = mapped;
+    return pinMapped(file, PageNo, mapped);
+  }
+  return pinPage(file, PageNo, page, &ring);
+}
+
+/**
+ * The work of readPage, without feeding the sequential access detector; allocPage uses it directly.
+ * A miss is read with the shard latch dropped, its frame pinned and marked as being read meanwhile,
+ * so that a shard has as many misses in flight as threads missing in it. A victim's dirty page is
+ * still written back with the latch held.
+ * @param file the pointer to the file
+ * @param PageNo the index of page inside the file
+ * @param page the reference of the pointer pointing to the address where page to be stored
+ * @param ring the ring of frames of a scan, or NULL for an ordinary read
+ * @return the same as readPage
+ */
+const Status BufMgr::pinPage(File* file, const pageno_t PageNo, Page*& page, BufRing* ring) 
 {
+  BufShard& shard = shardOf(file, PageNo);
+  ShardLatch latch(shard);
+  shard.stats.accesses++;
   int frameNo = -1;  
-  Status s = hashTable->lookup(file, PageNo, frameNo);
+  Status s = findPage(shard, file, PageNo, frameNo);
   if(s == OK){
     // it's in the buffer pool
     BufDesc* frame = &bufTable[frameNo];
-    frame->refbit = true;
+    if(frame->pinCnt == 0) shard.numUnpinned--;
     frame->pinCnt++;
+    if(!ring){
+      frame->scanOnly = false;
+      shard.replacer->hit(frameNo - shard.firstFrame);
+    }
     page = &(bufPool[frame->frameNo]);
   } else {
-    // it's not in the buffer pool
-    s = allocBuf(frameNo);
+    // it's not in the buffer pool: enter it, pinned and marked as being
+    // read so that anyone else after it waits in findPage, and read it
+    // with the latch dropped, so that other misses of the shard are in
+    // flight at the same time
+    if(ring) s = ringBuf(shard, *ring, file, PageNo, frameNo);
+    else s = allocBuf(shard, file, PageNo, frameNo);
     CHKSTAT(s); // BUFFEREXCEEDED, UNIXERR
-    Page* pPage = &bufPool[frameNo];
-    s = file->readPage(PageNo, pPage);
-    //if(statues != OK) return statues;
-    CHKSTAT(s); // UNIXERR
-    s = hashTable->insert(file, PageNo, frameNo);
-    CHKSTAT(s); // HASHTBLERR
-    bufTable[frameNo].Set(file, PageNo);
+    s = mapPage(shard, file, PageNo, frameNo);
+    if(s != OK){
+      releaseBuf(shard, frameNo);
+      return s; // HASHTBLERR
+    }
+    BufDesc* frame = &bufTable[frameNo];
+    frame->Set(file, PageNo);
+    frame->reading = true;
+    shard.numUnpinned--;
+    pthread_mutex_unlock(&shard.latch);
+    s = file->readPage(PageNo, &bufPool[frameNo]);
+    pthread_mutex_lock(&shard.latch);
+    frame->reading = false;
+    pthread_cond_broadcast(&shard.readDone);
+    if(s != OK){
+      unmapPage(shard, file, PageNo, frameNo);
+      frame->Clear();
+      shard.numUnpinned++;
+      releaseBuf(shard, frameNo);
+      return s; // UNIXERR
+    }
+    shard.stats.diskreads++;
+    if(ring){
+      bufTable[frameNo].scanOnly = true;
+      shard.replacer->loadedCold(frameNo - shard.firstFrame, file, PageNo);
+    } else
+      shard.replacer->loaded(frameNo - shard.firstFrame, file, PageNo);
     page = &(bufPool[frameNo]);
   }
   return OK;
@@ -179,11 +506,14 @@ const Status BufMgr::readPage(File* file, const int PageNo, Page*& page)
  * @return HASHNOTFOUND if the page is not in the buffer pool hash table
  * @return PAGENOTPINNED if the pin count is already 0
  */
-const Status BufMgr::unPinPage(File* file, const int PageNo, 
+const Status BufMgr::unPinPage(File* file, const pageno_t PageNo, 
 			       const bool dirty) 
 {
+  if(file->mappedPage(PageNo)) return unPinMapped(file, PageNo, dirty);
+  BufShard& shard = shardOf(file, PageNo);
+  ShardLatch latch(shard);
   int frameNo = -1;
-  Status s = hashTable->lookup(file, PageNo, frameNo);
+  Status s = findPage(shard, file, PageNo, frameNo);
   CHKSTAT(s); // HASHNOTFOUND
   BufDesc* frame = &bufTable[frameNo];
   if(dirty){
@@ -193,15 +523,232 @@ const Status BufMgr::unPinPage(File* file, const int PageNo,
     return PAGENOTPINNED;
   } else {
     frame->pinCnt--;
-    if(frame->pinCnt < 0) frame->pinCnt = 0;
+    if(frame->pinCnt == 0) shard.numUnpinned++;
   }
   return OK;
 }
 
+/**
+ * Pins a page of a mapped file that is read in place. No frame is used: only the pin count is kept, in the
+ * page's shard, along with the file's total, so that flushFile can still tell whether the file is in use.
+ * A shard has room for the counts of about as many mapped pages as it has frames.
+ * @param file the pointer to the file
+ * @param PageNo the index of page inside the file
+ * @param page the page in the file's mapping
+ * @return OK if no errors occurred
+ * @return BUFFEREXCEEDED if the shard has no room for another pinned mapped page
+ */
+const Status BufMgr::pinMapped(File* file, const pageno_t PageNo, Page* page)
+{
+  BufShard& shard = shardOf(file, PageNo);
+  ShardLatch latch(shard);
+  shard.stats.accesses++;
+  int pins, total;
+  bool first = shard.mappedPins->lookup(file, PageNo, pins) != OK;
+  if(first && shard.mappedPins->insert(file, PageNo, 1) != OK) return BUFFEREXCEEDED;
+  if(shard.mappedPins->lookup(file, FILEFRAMES, total) == OK)
+    shard.mappedPins->update(file, FILEFRAMES, total + 1);
+  else if(shard.mappedPins->insert(file, FILEFRAMES, 1) != OK){
+    if(first) shard.mappedPins->remove(file, PageNo);
+    return BUFFEREXCEEDED;
+  }
+  if(!first) shard.mappedPins->update(file, PageNo, pins + 1);
+  return OK;
+}
+
+/**
+ * Unpins a page read in place from a mapping. The mapping is read only, so the page cannot be dirty.
+ * @param file the pointer to the file
+ * @param PageNo the index of page inside the file
+ * @param dirty whether the page has been updated
+ * @return OK if no errors occurred
+ * @return PAGENOTPINNED if the page is not pinned
+ * @return BADBUFFER if dirty is set
+ */
+const Status BufMgr::unPinMapped(File* file, const pageno_t PageNo, const bool dirty)
+{
+  BufShard& shard = shardOf(file, PageNo);
+  ShardLatch latch(shard);
+  int pins, total;
+  if(PageNo == FILEFRAMES || shard.mappedPins->lookup(file, PageNo, pins) != OK) return PAGENOTPINNED;
+  if(pins == 1) shard.mappedPins->remove(file, PageNo);
+  else shard.mappedPins->update(file, PageNo, pins - 1);
+  shard.mappedPins->lookup(file, FILEFRAMES, total);
+  if(total == 1) shard.mappedPins->remove(file, FILEFRAMES);
+  else shard.mappedPins->update(file, FILEFRAMES, total - 1);
+  return dirty ? BADBUFFER : OK;
+}
+
+/**
+ * Read a page, returning a handle that unpins it when it goes out of scope.
+ * @param file the pointer to the file
+ * @param PageNo the index of page inside the file
+ * @param handle set to refer to the pinned page; whatever it referred to before is unpinned first
+ * @return the same as readPage
+ */
+const Status BufMgr::readPage(File* file, const pageno_t PageNo, PageHandle& handle)
+{
+  handle.release();
+  Page* page;
+  Status s = readPage(file, PageNo, page);
+  CHKSTAT(s);
+  bool inPool = page >= bufPool && page < bufPool + numBufs;
+  handle.take(this, file, PageNo, inPool ? page - bufPool : -1, page);
+  return OK;
+}
+
+/**
+ * Decrements the pin count of a frame handed out through a PageHandle, without a hash table lookup.
+ * The frame is checked to still hold the page, since disposePage may have taken it away.
+ * @param frameNo the index of the frame
+ * @param file the pointer to the file the frame was pinned for
+ * @param PageNo the index of the page the frame was pinned for
+ * @param dirty the dirty bit indicates if the page has been updated
+ * @return OK if no errors occurred
+ * @return HASHNOTFOUND if the frame no longer holds the page
+ * @return PAGENOTPINNED if the pin count is already 0
+ */
+const Status BufMgr::unPinFrame(const int frameNo, const File* file, const pageno_t PageNo,
+				const bool dirty)
+{
+  BufShard& shard = shardOf(file, PageNo);
+  ShardLatch latch(shard);
+  BufDesc* frame = &bufTable[frameNo];
+  if(!frame->valid || frame->file != file || frame->pageNo != PageNo) return HASHNOTFOUND;
+  if(dirty){
+    frame->dirty = true;
+  }
+  if(frame->pinCnt <= 0) return PAGENOTPINNED;
+  frame->pinCnt--;
+  if(frame->pinCnt == 0) shard.numUnpinned++;
+  return OK;
+}
+
+/**
+ * Pins a run of pages of a file. All shards the pages belong to are latched (in ascending order) for the
+ * whole call; hits are pinned right away, a frame is allocated for every miss, and the misses are then read
+ * with one File::readPages call straight into their frames, one request per run of consecutive misses.
+ * Pages of a mapped file are pinned in place instead.
+ * If anything fails, no page is left pinned.
+ * @param file the pointer to the file
+ * @param startPage the index of the first page inside the file
+ * @param n the number of pages
+ * @param pages the array receiving a pointer to each of the n pages
+ * @return OK if no errors occurred
+ * @return UNIXERR if a Unix error occurred
+ * @return BUFFEREXCEEDED if the frames needed could not all be allocated
+ * @return HASHTBLERROR if a hash table error occured
+ */
+const Status BufMgr::readPages(File* file, const pageno_t startPage, const int n, Page** pages)
+{
+  if(startPage < 1 || n < 0) return BADPAGENO;
+  // pages in the file's mapping come first; they are pinned in place
+  // once the rest of the run has been read
+  int mapped = 0;
+  while(mapped < n && file->mappedPage(startPage + mapped)) mapped++;
+  if(mapped > 0){
+    Status s = readPages(file, startPage + mapped, n - mapped, pages + mapped);
+    CHKSTAT(s);
+    for(int i = 0; i < mapped; i++){
+      pages[i] = file->mappedPage(startPage + i);
+      s = pinMapped(file, startPage + i, pages[i]);
+      if(s != OK){
+	for(int j = 0; j < i; j++) unPinMapped(file, startPage + j, false);
+	unPinPages(file, startPage + mapped, n - mapped, false);
+	return s; // BUFFEREXCEEDED
+      }
+    }
+    return OK;
+  }
+  std::vector<bool> latched(numShards, false);
+  std::vector<BufShard*> shardOfPage(n);
+  for(int i = 0; i < n; i++){
+    shardOfPage[i] = &shardOf(file, startPage + i);
+    latched[shardOfPage[i] - shards] = true;
+  }
+  for(int i = 0; i < numShards; i++)
+    if(latched[i]) pthread_mutex_lock(&shards[i].latch);
+
+  Status s = OK;
+  std::vector<int> frameOf(n, -1);
+  std::vector<bool> missed(n, false);
+  int i;
+  for(i = 0; i < n && s == OK; i++){
+    BufShard& shard = *shardOfPage[i];
+    shard.stats.accesses++;
+    if(findPage(shard, file, startPage + i, frameOf[i]) == OK){
+      BufDesc* frame = &bufTable[frameOf[i]];
+      if(frame->pinCnt == 0) shard.numUnpinned--;
+      frame->pinCnt++;
+      frame->scanOnly = false;
+      shard.replacer->hit(frameOf[i] - shard.firstFrame);
+    } else {
+      s = allocBuf(shard, file, startPage + i, frameOf[i]);
+      missed[i] = (s == OK);
+    }
+    if(s == OK) pages[i] = &bufPool[frameOf[i]];
+  }
+  // read all misses as one batch: each run of consecutive misses is one
+  // request, and the runs are in flight together
+  std::vector<PageIO> reads;
+  for(int j = 0; j < n && s == OK; j++){
+    if(!missed[j]) continue;
+    PageIO io = { startPage + j, pages[j] };
+    reads.push_back(io);
+  }
+  if(s == OK && !reads.empty()) s = file->readPages(&reads[0], reads.size());
+  for(int j = 0; j < n && s == OK; j++){
+    if(!missed[j]) continue;
+    BufShard& shard = *shardOfPage[j];
+    s = mapPage(shard, file, startPage + j, frameOf[j]);
+    if(s != OK) break;
+    shard.stats.diskreads++;
+    bufTable[frameOf[j]].Set(file, startPage + j);
+    shard.numUnpinned--;
+    shard.replacer->loaded(frameOf[j] - shard.firstFrame, file, startPage + j);
+    missed[j] = false;
+  }
+  if(s != OK){
+    // undo: unpin what was pinned, give back frames that were never filled
+    for(int j = 0; j < i; j++){
+      if(frameOf[j] < 0) continue;
+      BufShard& shard = *shardOfPage[j];
+      BufDesc* frame = &bufTable[frameOf[j]];
+      if(missed[j]){
+	releaseBuf(shard, frameOf[j]);
+      } else if(frame->valid && frame->file == file && frame->pageNo == startPage + j){
+	frame->pinCnt--;
+	if(frame->pinCnt == 0) shard.numUnpinned++;
+      }
+    }
+  }
+
+  for(int j = numShards - 1; j >= 0; j--)
+    if(latched[j]) pthread_mutex_unlock(&shards[j].latch);
+  return s;
+}
+
+/**
+ * Unpins a run of pages pinned by readPages.
+ * @param file the pointer to the file
+ * @param startPage the index of the first page inside the file
+ * @param n the number of pages
+ * @param dirty whether the pages have been updated
+ * @return OK if no errors occurred, otherwise the first error unPinPage reported
+ */
+const Status BufMgr::unPinPages(File* file, const pageno_t startPage, const int n, const bool dirty)
+{
+  Status result = OK;
+  for(int i = 0; i < n; i++){
+    Status s = unPinPage(file, startPage + i, dirty);
+    if(result == OK) result = s;
+  }
+  return result;
+}
+
 /**
  * Allocate an empty page in the specified file by invoking the file->allocatePage() method;
- * Then allocBuf() is called to obtain a buffer pool frame.
- * An entry is inserted into the hash table and Set() is invoked on the frame to set it up properly
+ * Then newFrame() pins it in a zeroed frame without reading it from disk.
  * @param file the pointer to the file
  * @param pageNo the index of the page inside the file
  * @param page the reference of the pointer pointing to the address where page to be stored
@@ -210,70 +757,669 @@ const Status BufMgr::unPinPage(File* file, const int PageNo,
  * @return BUFFEREXCEEDED if all buffer frames are pinned
  * @return HASHTBLERROR if a hash table error occurred
  */
-const Status BufMgr::allocPage(File* file, int& pageNo, Page*& page)  
+const Status BufMgr::allocPage(File* file, pageno_t& pageNo, Page*& page)  
 {
   Status s = file->allocatePage(pageNo);
   CHKSTAT(s); // UNIXERR
-  s = readPage(file, pageNo, page);
-  CHKSTAT(s); // UNIXERR, BUFFEREXCEEDED, HASHTBLERR
+  int frameNo;
+  {
+    BufShard& shard = shardOf(file, pageNo);
+    ShardLatch latch(shard);
+    s = newFrame(shard, file, pageNo, frameNo);
+  }
+  if(s != OK){
+    // give the page back to the file, so that it is not lost
+    file->disposePage(pageNo);
+    return s; // UNIXERR, BUFFEREXCEEDED, HASHTBLERR
+  }
+  page = &bufPool[frameNo];
+  return OK;
+}
+
+/**
+ * Pins a newly allocated page in a frame that is zeroed rather than read, since whatever is on disk is
+ * stale: a page reused from the free-space map keeps the contents it had when it was disposed of.
+ * Such a page may even be in the pool already, read while it was free by prefetch or readahead; then
+ * its frame is the one zeroed and pinned.
+ * The frame is marked dirty so that the zeroed page reaches the disk. The caller must hold the shard latch.
+ * @param shard the shard of the page
+ * @param file the pointer to the file
+ * @param pageNo the index of the page inside the file
+ * @param frameNo set to the index of the frame holding the page
+ * @return the same as allocBuf, or HASHTBLERROR if a hash table error occurred
+ */
+const Status BufMgr::newFrame(BufShard& shard, File* file, const pageno_t pageNo, int& frameNo)
+{
+  if(findPage(shard, file, pageNo, frameNo) == OK){
+    BufDesc* frame = &bufTable[frameNo];
+    shard.stats.accesses++;
+    memset(&bufPool[frameNo], 0, sizeof(Page));
+    frame->dirty = true;
+    frame->scanOnly = false;
+    if(frame->pinCnt == 0) shard.numUnpinned--;
+    frame->pinCnt++;
+    shard.replacer->hit(frameNo - shard.firstFrame);
+    return OK;
+  }
+  Status s = allocBuf(shard, file, pageNo, frameNo);
+  CHKSTAT(s); // UNIXERR, BUFFEREXCEEDED
+  s = mapPage(shard, file, pageNo, frameNo);
+  if(s != OK){
+    releaseBuf(shard, frameNo);
+    return s;
+  }
+  shard.stats.accesses++;
+  memset(&bufPool[frameNo], 0, sizeof(Page));
+  bufTable[frameNo].Set(file, pageNo);
+  bufTable[frameNo].dirty = true;
+  shard.numUnpinned--;
+  shard.replacer->loaded(frameNo - shard.firstFrame, file, pageNo);
   return OK;
 }
 
+/**
+ * Allocate an empty page in the specified file, returning a handle that unpins it when it goes out of scope.
+ * @param file the pointer to the file
+ * @param pageNo the index of the page inside the file
+ * @param handle set to refer to the pinned page; whatever it referred to before is unpinned first
+ * @return the same as allocPage
+ */
+const Status BufMgr::allocPage(File* file, pageno_t& pageNo, PageHandle& handle)
+{
+  handle.release();
+  Page* page;
+  Status s = allocPage(file, pageNo, page);
+  CHKSTAT(s);
+  handle.take(this, file, pageNo, page - bufPool, page);
+  return OK;
+}
+
+/**
+ * Allocate n contiguous pages of the file with one file->allocatePages() call, then pin each with newFrame()
+ * in a zeroed frame instead of reading it.
+ * All shards the pages belong to are latched (in ascending order) while the frames are set up.
+ * If no frame can be found for some page, no page is left pinned, and the pages are given back to the file.
+ * @param file the pointer to the file
+ * @param n the number of pages
+ * @param firstPageNo set to the index of the first page allocated
+ * @param pages the array receiving a pointer to each of the n pages
+ * @return OK if no errors occurred
+ * @return UNIXERR if a Unix error occurred
+ * @return BUFFEREXCEEDED if the frames needed could not all be allocated
+ * @return HASHTBLERROR if a hash table error occurred
+ */
+const Status BufMgr::allocPages(File* file, const int n, pageno_t& firstPageNo, Page** pages)
+{
+  Status s = file->allocatePages(n, firstPageNo);
+  CHKSTAT(s); // UNIXERR, BADPAGENO
+  std::vector<bool> latched(numShards, false);
+  std::vector<BufShard*> shardOfPage(n);
+  for(int i = 0; i < n; i++){
+    shardOfPage[i] = &shardOf(file, firstPageNo + i);
+    latched[shardOfPage[i] - shards] = true;
+  }
+  for(int i = 0; i < numShards; i++)
+    if(latched[i]) pthread_mutex_lock(&shards[i].latch);
+
+  int i;
+  for(i = 0; i < n && s == OK; i++){
+    int frameNo;
+    s = newFrame(*shardOfPage[i], file, firstPageNo + i, frameNo);
+    if(s != OK) break;
+    pages[i] = &bufPool[frameNo];
+  }
+  if(s != OK){
+    // undo: take the pages that were pinned back out of the pool
+    for(int j = 0; j < i; j++){
+      BufShard& shard = *shardOfPage[j];
+      int frameNo = pages[j] - bufPool;
+      bufTable[frameNo].Clear();
+      unmapPage(shard, file, firstPageNo + j, frameNo);
+      shard.replacer->dropped(frameNo - shard.firstFrame);
+      shard.numUnpinned++;
+      releaseBuf(shard, frameNo);
+    }
+  }
+
+  for(int j = numShards - 1; j >= 0; j--)
+    if(latched[j]) pthread_mutex_unlock(&shards[j].latch);
+  if(s != OK)
+    for(int j = 0; j < n; j++) file->disposePage(firstPageNo + j);
+  return s;
+}
+
 /**
  * If a page exists in the buffer pool, clear the page, remove the corresponding entry from the hash table and dispose the page in the file as well. 
+ * If the background writer is writing the page, wait for its round to end first, so that the write cannot
+ * land after the page has been disposed of, or in a frame that has been reused.
  * @param file the pointer to the file
  * @param pageNo the index of the page inside the file
  * @return the status of the call to dispose the page in the file.
  */
-const Status BufMgr::disposePage(File* file, const int pageNo) 
+const Status BufMgr::disposePage(File* file, const pageno_t pageNo) 
 {
+  BufShard& shard = shardOf(file, pageNo);
   int frameNo = -1;
-  Status s = hashTable->lookup(file, pageNo, frameNo);
+  Status s;
+  pthread_mutex_lock(&writerLock);
+  for(;;){
+    pthread_mutex_lock(&shard.latch);
+    s = findPage(shard, file, pageNo, frameNo);
+    if(s != OK || !bufTable[frameNo].writing) break;
+    pthread_mutex_unlock(&shard.latch);
+    pthread_cond_wait(&writeDone, &writerLock);
+  }
+  pthread_mutex_unlock(&writerLock);
   if(s == OK){
     BufDesc* frame = &bufTable[frameNo];
+    if(frame->pinCnt > 0) shard.numUnpinned++;
     frame->Clear();
-    hashTable->remove(file, pageNo);
+    unmapPage(shard, file, pageNo, frameNo);
+    shard.replacer->dropped(frameNo - shard.firstFrame);
+    releaseBuf(shard, frameNo);
   }
-  s = file->disposePage(pageNo);
-  return s;
+  pthread_mutex_unlock(&shard.latch);
+  return file->disposePage(pageNo);
 }
 
 /**
- * Scan bufTable for pages belonging to the file, for every page:
- * 1. if the page is dirty, call file->writePage() to flush the page to disk and then set the dirty bit for the page to false;
- * 2. remove the page from the hashtable (whether the page is clean or dirty);
- * 3. invoke the Clear() method on the page frame.
+ * Collect the frames of the file from its list in every shard, then:
+ * 1. write the dirty pages to disk in ascending page order, with one file->writePages() call that writes each run of adjacent pages at once,
+ *    and set their dirty bits to false;
+ * 2. remove every page from the hashtable (whether the page is clean or dirty);
+ * 3. invoke the Clear() method on the page frame;
+ * 4. write the file's cached header page if it changed.
+ * The cost depends on the number of pages of the file in the pool, not on the size of the pool.
+ * The frames are gathered with all shard latches taken (in ascending order), once the background
+ * writer is done with any page of the file it is writing. As in cleanShard, the dirty ones are then
+ * pinned, marked as being written and marked clean, and the latches are dropped for the write, so
+ * other files are not held up by it. The frames are gathered again afterwards, picking up pages of
+ * the file used meanwhile, and are removed once none of them is dirty.
  * @param file the pointer to the file
  * @return OK if no errors occurred
- * @return PAGEPINNED if some page of the file is pinned
+ * @return PAGEPINNED if some page of the file is pinned, including pages read in place from its mapping
  */
 const Status BufMgr::flushFile(const File* file) 
 {
-  // first check if all pages of this file are unpinned
+  // forget the file's readahead, and wait out a prefetch of one of its pages
+  pthread_mutex_lock(&prefetchLock);
+  for(std::deque<PageRequest>::iterator it = prefetchQueue.begin(); it != prefetchQueue.end(); ){
+    if(it->file == file) it = prefetchQueue.erase(it);
+    else ++it;
+  }
+  readAhead.erase(file);
+  while(prefetchInFlight == file)
+    pthread_cond_wait(&prefetchIdle, &prefetchLock);
+  pthread_mutex_unlock(&prefetchLock);
+
   File* pFile = const_cast<File*>(file);
-  std::vector<BufDesc*> frames;
-  for(int i = 0; i < numBufs; i++){
-    BufDesc* frame = &bufTable[i];
-    if(frame->file == pFile){
-      frames.push_back(frame);
+  Status s;
+  std::vector<PageIO> frames;
+  std::vector<PageIO> dirty;
+  for(;;){
+    // gather the frames of the file from the list of every shard,
+    // checking that none is pinned; if one is being written, by the
+    // background writer or another flush, wait for that to end and
+    // start over
+    pthread_mutex_lock(&writerLock);
+    for(;;){
+      for(int i = 0; i < numShards; i++) pthread_mutex_lock(&shards[i].latch);
+      s = OK;
+      frames.clear();
+      bool writing = false;
+      for(int i = 0; i < numShards && s == OK; i++){
+	int f;
+	if(shards[i].mappedPins->lookup(file, FILEFRAMES, f) == OK) s = PAGEPINNED;
+	if(shards[i].hashTable->lookup(file, FILEFRAMES, f) != OK) continue;
+	for(; f >= 0; f = bufTable[f].fileNext){
+	  if(bufTable[f].writing) writing = true;
+	  else if(bufTable[f].pinCnt > 0) s = PAGEPINNED;
+	  PageIO io = { bufTable[f].pageNo, bufPool + f };
+	  frames.push_back(io);
+	}
+      }
+      if(!writing || s != OK) break;
+      for(int i = numShards - 1; i >= 0; i--) pthread_mutex_unlock(&shards[i].latch);
+      pthread_cond_wait(&writeDone, &writerLock);
     }
-    if(frame->pinCnt > 0) return PAGEPINNED;
-  }
-  for(unsigned int i = 0; i < frames.size(); i++){
-    BufDesc* pFrame = frames[i];
-    if(pFrame->dirty){
-      // flush to disk
-      Status s = pFile->writePage(pFrame->pageNo, bufPool + pFrame->frameNo);
-      CHKSTAT(s);
-      pFrame->dirty = false;
+    pthread_mutex_unlock(&writerLock);
+    dirty.clear();
+    for(std::vector<PageIO>::iterator it = frames.begin(); s == OK && it != frames.end(); ++it){
+      BufDesc* frame = &bufTable[it->page - bufPool];
+      if(!frame->dirty) continue;
+      frame->pinCnt++;
+      shardOf(pFile, it->pageNo).numUnpinned--;
+      frame->writing = true;
+      frame->dirty = false;
+      dirty.push_back(*it);
     }
-    Status s = hashTable->remove(pFile, pFrame->pageNo);
-    CHKSTAT(s);
-    pFrame->Clear();
+    if(s != OK || dirty.empty()) break;
+    for(int i = numShards - 1; i >= 0; i--) pthread_mutex_unlock(&shards[i].latch);
+
+    // flush the dirty pages to disk in ascending page order; writePages
+    // gathers each run of adjacent pages into one write
+    std::sort(dirty.begin(), dirty.end(), pageOrder);
+    s = pFile->writePages(&dirty[0], dirty.size());
+    for(std::vector<PageIO>::iterator it = dirty.begin(); it != dirty.end(); ++it){
+      BufShard& shard = shardOf(pFile, it->pageNo);
+      BufDesc* frame = &bufTable[it->page - bufPool];
+      ShardLatch latch(shard);
+      frame->writing = false;
+      frame->pinCnt--;
+      if(frame->pinCnt == 0) shard.numUnpinned++;
+      if(s != OK) frame->dirty = true;
+      else shard.stats.diskwrites++;
+    }
+    pthread_mutex_lock(&writerLock);
+    pthread_cond_broadcast(&writeDone);
+    pthread_mutex_unlock(&writerLock);
+    if(s != OK) return s;
+  }
+  // then remove the pages from the pool, all of them clean now
+  for(std::vector<PageIO>::iterator it = frames.begin(); it != frames.end() && s == OK; ++it){
+    BufShard& shard = shardOf(pFile, it->pageNo);
+    int frameNo = it->page - bufPool;
+    s = unmapPage(shard, pFile, it->pageNo, frameNo);
+    if(s != OK) break;
+    shard.replacer->dropped(frameNo - shard.firstFrame);
+    bufTable[frameNo].Clear();
+    releaseBuf(shard, frameNo);
+  }
+  for(int i = numShards - 1; i >= 0; i--) pthread_mutex_unlock(&shards[i].latch);
+  if(s == OK) s = pFile->syncHeader();
+  return s;
+}
+
+/**
+ * Sums up the statistics of all shards, and counts the evicted pages their replacers still remember.
+ * @return the buffer pool usage since the last clearBufStats()
+ */
+const BufStats BufMgr::getBufStats() const
+{
+  BufStats total;
+  for(int i = 0; i < numShards; i++){
+    ShardLatch latch(shards[i]);
+    total.accesses += shards[i].stats.accesses;
+    total.diskreads += shards[i].stats.diskreads;
+    total.diskwrites += shards[i].stats.diskwrites;
+    total.fgwrites += shards[i].stats.fgwrites;
+    total.bgwrites += shards[i].stats.bgwrites;
+    total.prefetches += shards[i].stats.prefetches;
+    total.lookups += shards[i].stats.lookups;
+    total.ghosts += shards[i].replacer->remembered();
+  }
+  return total;
+}
+
+/**
+ * Resets the statistics of all shards.
+ */
+const void BufMgr::clearBufStats()
+{
+  for(int i = 0; i < numShards; i++){
+    ShardLatch latch(shards[i]);
+    shards[i].stats.clear();
+  }
+}
+
+/**
+ * Starts the background writer thread.
+ * @param intervalMs milliseconds the writer sleeps between rounds
+ * @param pagesPerRound number of frames per shard, next in eviction order, looked at in each round
+ * @return OK if the writer was started
+ * @return BADBUFFER if it is already running or the parameters are not positive
+ * @return UNIXERR if the thread could not be created
+ */
+const Status BufMgr::startWriter(const int intervalMs, const int pagesPerRound)
+{
+  if(writerRunning || intervalMs <= 0 || pagesPerRound <= 0) return BADBUFFER;
+  writerInterval = intervalMs;
+  writerPages = pagesPerRound;
+  writerRunning = true;
+  if(pthread_create(&writer, NULL, writerMain, this) != 0){
+    writerRunning = false;
+    return UNIXERR;
   }
   return OK;
 }
 
+/**
+ * Stops the background writer, if running, and waits for it to exit.
+ */
+const void BufMgr::stopWriter()
+{
+  if(!writerRunning) return;
+  pthread_mutex_lock(&writerLock);
+  writerRunning = false;
+  pthread_cond_signal(&writerWake);
+  pthread_mutex_unlock(&writerLock);
+  pthread_join(writer, NULL);
+}
+
+/**
+ * Body of the writer thread: one cleaning round over every shard, then a sleep, until stopped.
+ * @param mgr the buffer manager the writer belongs to
+ */
+void* BufMgr::writerMain(void* mgr)
+{
+  BufMgr* self = (BufMgr*) mgr;
+  pthread_mutex_lock(&self->writerLock);
+  while(self->writerRunning){
+    pthread_mutex_unlock(&self->writerLock);
+    for(int i = 0; i < self->numShards; i++)
+      self->cleanShard(self->shards[i]);
+
+    struct timespec wake;
+    clock_gettime(CLOCK_REALTIME, &wake);
+    wake.tv_sec += self->writerInterval / 1000;
+    wake.tv_nsec += (self->writerInterval % 1000) * 1000000L;
+    if(wake.tv_nsec >= 1000000000L){
+      wake.tv_sec++;
+      wake.tv_nsec -= 1000000000L;
+    }
+    pthread_mutex_lock(&self->writerLock);
+    if(self->writerRunning)
+      pthread_cond_timedwait(&self->writerWake, &self->writerLock, &wake);
+  }
+  pthread_mutex_unlock(&self->writerLock);
+  return NULL;
+}
+
+/**
+ * Writes back the dirty, unpinned pages among the frames the shard's policy would evict next.
+ * The frames are picked under the latch, pinned so that they cannot be evicted, marked as being
+ * written and marked clean; the latch is then dropped for the writes, so foreground callers never
+ * wait for them. At most half of the shard's unpinned frames are taken, so that a miss still finds one. The pages of each file are written with one File::writePages call, so the I/O
+ * backend has the whole round in flight at once. Whoever dirties a page while it is being written
+ * sets its dirty bit again, and a page whose write fails is marked dirty again.
+ * disposePage and flushFile wait for the round to end before they take away a frame being written.
+ * @param shard the shard to clean
+ */
+void BufMgr::cleanShard(BufShard& shard)
+{
+  std::vector<int> frames(writerPages);
+  std::map<File*, std::vector<PageIO> > writes;
+  {
+    ShardLatch latch(shard);
+    int n = shard.replacer->upcoming(&frames[0], writerPages);
+    int budget = shard.numUnpinned / 2;
+    for(int i = 0; i < n && budget > 0; i++){
+      BufDesc* frame = &bufTable[shard.firstFrame + frames[i]];
+      if(!frame->valid || !frame->dirty || frame->pinCnt > 0) continue;
+      budget--;
+      frame->pinCnt++;
+      shard.numUnpinned--;
+      frame->writing = true;
+      frame->dirty = false;
+      PageIO io = { frame->pageNo, bufPool + frame->frameNo };
+      writes[frame->file].push_back(io);
+    }
+  }
+  if(writes.empty()) return;
+
+  std::vector<Status> status;
+  for(std::map<File*, std::vector<PageIO> >::iterator it = writes.begin(); it != writes.end(); ++it){
+    std::vector<PageIO>& pages = it->second;
+    std::sort(pages.begin(), pages.end(), pageOrder);
+    status.push_back(it->first->writePages(&pages[0], pages.size()));
+  }
+
+  {
+    ShardLatch latch(shard);
+    int k = 0;
+    for(std::map<File*, std::vector<PageIO> >::iterator it = writes.begin(); it != writes.end(); ++it, k++){
+      for(int i = 0; i < (int)it->second.size(); i++){
+	BufDesc* frame = &bufTable[it->second[i].page - bufPool];
+	frame->writing = false;
+	frame->pinCnt--;
+	if(frame->pinCnt == 0) shard.numUnpinned++;
+	if(status[k] != OK){
+	  frame->dirty = true;
+	  continue;
+	}
+	shard.stats.diskwrites++;
+	shard.stats.bgwrites++;
+      }
+    }
+  }
+  pthread_mutex_lock(&writerLock);
+  pthread_cond_broadcast(&writeDone);
+  pthread_mutex_unlock(&writerLock);
+}
+
+/**
+ * Queues a run of pages to be read ahead by the prefetch thread, starting the thread on first use.
+ * @param file the pointer to the file
+ * @param firstPage the index of the first page to read ahead
+ * @param count the number of pages to read ahead
+ * @return OK if the pages were queued
+ * @return BADPAGENO if the run starts before the first data page
+ * @return UNIXERR if the prefetch thread could not be created
+ */
+const Status BufMgr::prefetch(File* file, const pageno_t firstPage, const int count)
+{
+  if(firstPage < 1) return BADPAGENO;
+  if(file->mappedPage(firstPage)){
+    // the mapping is read in place; let the kernel read it ahead
+    file->willNeed(firstPage, count);
+    return OK;
+  }
+  pthread_mutex_lock(&prefetchLock);
+  queuePrefetch(file, firstPage, count);
+  bool started = prefetcherRunning;
+  pthread_mutex_unlock(&prefetchLock);
+  return started ? OK : UNIXERR;
+}
+
+/**
+ * Turns the automatic sequential readahead on or off.
+ * @param maxWindow the largest number of pages read ahead in one batch, 0 to turn readahead off
+ */
+const void BufMgr::setReadAhead(const int maxWindow)
+{
+  pthread_mutex_lock(&prefetchLock);
+  maxReadAhead = maxWindow > 0 ? maxWindow : 0;
+  readAhead.clear();
+  pthread_mutex_unlock(&prefetchLock);
+}
+
+/**
+ * Appends pages to the prefetch queue and wakes the prefetch thread, creating it if needed.
+ * The caller must hold prefetchLock.
+ * @param file the pointer to the file
+ * @param firstPage the index of the first page to read ahead
+ * @param count the number of pages to read ahead
+ */
+void BufMgr::queuePrefetch(File* file, const pageno_t firstPage, const int count)
+{
+  if(!prefetcherRunning){
+    if(pthread_create(&prefetcher, NULL, prefetcherMain, this) != 0) return;
+    prefetcherRunning = true;
+  }
+  for(int i = 0; i < count; i++){
+    PageRequest request = { file, firstPage + i };
+    prefetchQueue.push_back(request);
+  }
+  pthread_cond_signal(&prefetchWake);
+}
+
+/**
+ * Updates the sequential access detector of a file after a successful readPage,
+ * queueing the next batch when the reader gets within half a window of the pages already queued.
+ * @param file the pointer to the file
+ * @param pageNo the index of the page just read
+ */
+void BufMgr::noteAccess(File* file, const pageno_t pageNo)
+{
+  const int minWindow = 4;
+  pthread_mutex_lock(&prefetchLock);
+  std::map<const File*, ReadAhead>::iterator it = readAhead.find(file);
+  if(it == readAhead.end()){
+    ReadAhead fresh = { pageNo, 0, 0, 0 };
+    readAhead[file] = fresh;
+    pthread_mutex_unlock(&prefetchLock);
+    return;
+  }
+  ReadAhead& ra = it->second;
+  if(pageNo == ra.lastPage + 1){
+    ra.run++;
+  } else {
+    // the run is broken: back off
+    ra.run = 0;
+    ra.window /= 2;
+  }
+  ra.lastPage = pageNo;
+  if(ra.run >= 2){
+    if(ra.nextFetch <= pageNo){
+      // (re)starting a run
+      if(ra.window < minWindow) ra.window = minWindow;
+      ra.nextFetch = pageNo + 1;
+      queuePrefetch(file, ra.nextFetch, ra.window);
+      ra.nextFetch += ra.window;
+    } else if(ra.nextFetch - pageNo <= ra.window / 2){
+      // the reader is catching up: ramp up
+      ra.window = ra.window * 2 < maxReadAhead ? ra.window * 2 : maxReadAhead;
+      queuePrefetch(file, ra.nextFetch, ra.window);
+      ra.nextFetch += ra.window;
+    }
+  }
+  pthread_mutex_unlock(&prefetchLock);
+}
+
+/**
+ * Body of the prefetch thread: reads queued pages until told to stop, each run of
+ * consecutive pages of a file (up to maxPrefetchBatch) as one batch.
+ * When a page cannot be read, presumably because it lies beyond the end of the file,
+ * the queued pages of that file after it are dropped too.
+ * @param mgr the buffer manager the thread belongs to
+ */
+void* BufMgr::prefetcherMain(void* mgr)
+{
+  BufMgr* self = (BufMgr*) mgr;
+  pthread_mutex_lock(&self->prefetchLock);
+  while(!self->prefetcherStop){
+    if(self->prefetchQueue.empty()){
+      pthread_cond_wait(&self->prefetchWake, &self->prefetchLock);
+      continue;
+    }
+    // take the run of pages of one file at the front of the queue
+    PageRequest request = self->prefetchQueue.front();
+    self->prefetchQueue.pop_front();
+    int count = 1;
+    while(count < maxPrefetchBatch && !self->prefetchQueue.empty()
+	  && self->prefetchQueue.front().file == request.file
+	  && self->prefetchQueue.front().pageNo == request.pageNo + count){
+      self->prefetchQueue.pop_front();
+      count++;
+    }
+    self->prefetchInFlight = request.file;
+    pthread_mutex_unlock(&self->prefetchLock);
+
+    pageno_t failed = -1;
+    if(self->loadPages(request.file, request.pageNo, count) == UNIXERR){
+      // probably the run goes past the end of the file: load it a page
+      // at a time to get the pages before the end
+      for(int i = 0; i < count && failed < 0; i++)
+	if(self->loadPage(request.file, request.pageNo + i) == UNIXERR)
+	  failed = request.pageNo + i;
+    }
+
+    pthread_mutex_lock(&self->prefetchLock);
+    self->prefetchInFlight = NULL;
+    pthread_cond_broadcast(&self->prefetchIdle);
+    if(failed >= 0){
+      std::deque<PageRequest>::iterator it = self->prefetchQueue.begin();
+      while(it != self->prefetchQueue.end()){
+	if(it->file == request.file && it->pageNo > failed)
+	  it = self->prefetchQueue.erase(it);
+	else ++it;
+      }
+    }
+  }
+  pthread_mutex_unlock(&self->prefetchLock);
+  return NULL;
+}
+
+/**
+ * Reads a page into a frame if it is not cached yet, leaving it unpinned.
+ * @param file the pointer to the file
+ * @param pageNo the index of page inside the file
+ * @return OK if the page is now cached
+ * @return UNIXERR if the page could not be read
+ * @return BUFFEREXCEEDED if all buffer frames of the page's shard are pinned
+ */
+const Status BufMgr::loadPage(File* file, const pageno_t pageNo)
+{
+  BufShard& shard = shardOf(file, pageNo);
+  ShardLatch latch(shard);
+  int frameNo = -1;
+  if(findPage(shard, file, pageNo, frameNo) == OK) return OK;
+  Status s = allocBuf(shard, file, pageNo, frameNo);
+  CHKSTAT(s); // BUFFEREXCEEDED, UNIXERR
+  s = file->readPage(pageNo, &bufPool[frameNo]);
+  if(s == OK) s = mapPage(shard, file, pageNo, frameNo);
+  if(s != OK){
+    releaseBuf(shard, frameNo);
+    return s;
+  }
+  shard.stats.diskreads++;
+  shard.stats.prefetches++;
+  bufTable[frameNo].Set(file, pageNo);
+  bufTable[frameNo].pinCnt = 0;   // Set() pins the page for its reader; there is none
+  shard.replacer->loaded(frameNo - shard.firstFrame, file, pageNo);
+  return OK;
+}
+
+/**
+ * Reads the pages of a run that are not cached yet into frames, leaving them unpinned, with one
+ * File::readPages call. All shards the pages belong to are latched (in ascending order) for the call.
+ * If no frame is free for some page, the run is cut short there.
+ * @param file the pointer to the file
+ * @param firstPage the index of the first page of the run
+ * @param count the number of pages
+ * @return OK if the pages are now cached, or as many as frames could be found for
+ * @return UNIXERR if the pages could not be read, in which case none of them was loaded
+ * @return HASHTBLERROR if a hash table error occurred
+ */
+const Status BufMgr::loadPages(File* file, const pageno_t firstPage, const int count)
+{
+  std::vector<bool> latched(numShards, false);
+  for(int i = 0; i < count; i++)
+    latched[&shardOf(file, firstPage + i) - shards] = true;
+  for(int i = 0; i < numShards; i++)
+    if(latched[i]) pthread_mutex_lock(&shards[i].latch);
+
+  std::vector<PageIO> reads;
+  for(int i = 0; i < count; i++){
+    BufShard& shard = shardOf(file, firstPage + i);
+    int frameNo = -1;
+    if(findPage(shard, file, firstPage + i, frameNo) == OK) continue;
+    if(allocBuf(shard, file, firstPage + i, frameNo) != OK) break;
+    PageIO io = { firstPage + i, &bufPool[frameNo] };
+    reads.push_back(io);
+  }
+  Status s = OK;
+  if(!reads.empty()) s = file->readPages(&reads[0], reads.size());
+  for(int i = 0; i < (int)reads.size(); i++){
+    BufShard& shard = shardOf(file, reads[i].pageNo);
+    int frameNo = reads[i].page - bufPool;
+    if(s == OK) s = mapPage(shard, file, reads[i].pageNo, frameNo);
+    if(s != OK){
+      releaseBuf(shard, frameNo);
+      continue;
+    }
+    shard.stats.diskreads++;
+    shard.stats.prefetches++;
+    bufTable[frameNo].Set(file, reads[i].pageNo);
+    bufTable[frameNo].pinCnt = 0;   // Set() pins the page for its reader; there is none
+    shard.replacer->loaded(frameNo - shard.firstFrame, file, reads[i].pageNo);
+  }
+
+  for(int i = numShards - 1; i >= 0; i--)
+    if(latched[i]) pthread_mutex_unlock(&shards[i].latch);
+  return s;
+}
+
 
   void BufMgr::printSelf(void) 
   {
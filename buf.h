@@ -1,60 +1,98 @@
 #ifndef BUF_H
 #define BUF_H
 
+#include <pthread.h>
+#include <deque>
+#include <utility>
+#include <map>
+#include <vector>
 #include "db.h"
 // define if debug output wanted
 //#define DEBUGBUF
 
+// mixes (file, pageNo) into 64 well-distributed bits.  BufMgr picks a
+// shard from the low bits and BufHashTbl a slot from the high bits, so
+// the two choices stay independent.
+inline unsigned long hashPage(const File* file, const pageno_t pageNo)
+{
+  unsigned long h = (unsigned long)file
+    ^ ((unsigned long)pageNo << 32 | (unsigned long)pageNo >> 32);
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdUL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53UL;
+  h ^= h >> 33;
+  return h;
+}
+
 // declarations for buffer pool hash table
 struct hashBucket
 {
-	File*	file;    // pointer a file object (more on this below)
-	int	pageNo;  // page number within a file
+	const File*	file;    // pointer a file object (more on this below); NULL if slot empty
+	pageno_t pageNo; // page number within a file
 	int	frameNo; // frame number of page in the buffer pool
-	hashBucket* 	next;	 // next node in the hash table
 };
 
 
-// hash table to keep track of pages in the buffer pool
+// hash table to keep track of pages in the buffer pool.  Uses linear
+// probing over a single array of inline buckets, so lookups touch
+// contiguous memory and insert/remove never allocate.  Removal shifts the
+// following run of buckets back instead of leaving tombstones.
 class BufHashTbl
 {
 private:
-    int HTSIZE;
-    hashBucket**  ht; // actual hash table
-    int	 hash(const File* file, const int pageNo); // returns value between 0 and HTSIZE-1
+    int HTSIZE;       // number of slots, a power of two
+    int shift;        // 64 - log2(HTSIZE)
+    int numEntries;   // number of slots in use
+    hashBucket*  ht;  // actual hash table
+    int	 hash(const File* file, const pageno_t pageNo) const; // returns value between 0 and HTSIZE-1
 
 public:
-    BufHashTbl(const int htSize);  // constructor
+    BufHashTbl(const int numFrames);  // constructor, sized for numFrames entries
     ~BufHashTbl(); // destructor
 	
     // insert entry into hash table mapping (file,pageNo) to frameNo;
     // returns 0 if OK, HASHTBLERROR if an error occurred
-  Status insert(const File* file, const int pageNo, const int frameNo);
+  Status insert(const File* file, const pageno_t pageNo, const int frameNo);
 
     // Check if (file,pageNo) is currently in the buffer pool (ie. in
     // the hash table).  If so, return corresponding frameNo. else return 
     // HASHNOTFOUND
-  Status lookup(const File* file, const int pageNo, int & frameNo);
+  Status lookup(const File* file, const pageno_t pageNo, int & frameNo) const;
 
     // delete entry (file,pageNo) from hash table. REturn OK if page was
     // found.  Else return HASHTBLERROR
-  Status remove(const File* file, const int pageNo);  
+  Status remove(const File* file, const pageno_t pageNo);  
+
+    // change the frameNo stored for (file,pageNo); returns HASHNOTFOUND
+    // if there is no such entry
+  Status update(const File* file, const pageno_t pageNo, const int frameNo);
 };
 
 
 class BufMgr;  //forward declaration of BufMgr class 
+class Replacer;  // page replacement policy, see replacer.h
+
+// page replacement policies a BufMgr can be built with
+enum Replacement { CLOCK, LRUK, TWOQ, ARC };
 
 // class for maintaining information about buffer pool frames
 class BufDesc {
     friend class BufMgr;
+    friend class Replacer;
 private:
   File* file;   // pointer to file object
-  int   pageNo; // page within file
+  pageno_t pageNo; // page within file
   int	frameNo;  // frame # of frame
   int   pinCnt; // number of times this page has been pinned
   bool 	dirty;	  // true if dirty;  false otherwise
   bool 	valid;   // true if page is valid
   bool  refbit;	 // has this buffer frame been reference recently
+  bool  scanOnly; // page was loaded by a BufRing and not used by anyone else since
+  bool  writing;  // being written back by the background writer or flushFile, which holds a pin
+  bool  reading;  // being read in by the readPage that missed it, which holds a pin
+  int   fileNext; // next frame in the shard holding a page of the same file, or -1
+  int   filePrev; // previous such frame, or -1 for the first
 
   void Clear() {  // initialize buffer frame for a new user
     	pinCnt = 0;
@@ -62,15 +100,21 @@ private:
 	pageNo = -1;
     	dirty = false;
 	valid = false;
+	scanOnly = false;
+	writing = false;
+	reading = false;
   };
 
-  void Set(File* filePtr, int pageNum) { 
+  void Set(File* filePtr, pageno_t pageNum) { 
       file = filePtr;
       pageNo = pageNum;
       pinCnt = 1;
       dirty = false;
       valid = true;
       refbit = true;
+      scanOnly = false;
+      writing = false;
+      reading = false;
   }
 
   BufDesc() {
@@ -84,10 +128,16 @@ struct BufStats
   int accesses;    // Total number of accesses to buffer pool
   int diskreads;   // Number of pages read from disk (including allocs)
   int diskwrites;  // Number of pages written back to disk
+  int fgwrites;    // of those, written while evicting for a readPage/allocPage
+  int bgwrites;    // of those, written by the background writer
+  int prefetches;  // Number of the disk reads done ahead of time by prefetch
+  int lookups;     // Number of hash table lookups
+  int ghosts;      // Number of evicted pages the replacement policy still remembers
 
   void clear()
     {
-      accesses = diskreads = diskwrites = 0;
+      accesses = diskreads = diskwrites = fgwrites = bgwrites = prefetches = 0;
+      lookups = ghosts = 0;
     }
       
   BufStats()
@@ -97,46 +147,266 @@ struct BufStats
 };
 
 
+// a page waiting to be read ahead
+struct PageRequest
+{
+  File*	file;    // file the page belongs to
+  pageno_t pageNo; // page within file
+};
+
+// sequential access detector kept for every file readahead is working on
+struct ReadAhead
+{
+  pageno_t lastPage;  // page most recently requested through readPage
+  int run;            // number of consecutive requests for the next page
+  int window;         // pages read ahead per batch, 0 until a run is seen
+  pageno_t nextFetch; // first page not yet queued for readahead
+};
+
+
+// A scan access strategy: the private ring of frames a bulk sequential
+// reader recycles, so that its pages neither compete with everyone else's
+// in the replacement policy nor count as recently referenced.  Pass the
+// same ring to every readPage of one scan; it must only be used with one
+// BufMgr and by one thread at a time.
+class BufRing
+{
+  friend class BufMgr;
+public:
+  BufRing(const int numFrames) : size(numFrames), perShard(0) {}
+
+private:
+  int size;                               // frames in the ring
+  int perShard;                           // of those, frames in each shard
+  std::vector<std::vector<int> > frames;  // per shard: frames the ring filled
+  std::vector<int> next;                  // per shard: ring slot to recycle next
+};
+
+
+// A pinned page, as handed out by the PageHandle overloads of readPage and
+// allocPage.  The handle remembers the frame, so unpinning it needs no hash
+// table lookup, and it unpins the page when it is destroyed or assigned
+// to.  Handles can be moved but not copied, so every pin has one owner.
+class PageHandle
+{
+  friend class BufMgr;
+public:
+  PageHandle() : mgr(NULL), file(NULL), pageNum(-1), frameNo(-1), pagePtr(NULL), dirty(false) {}
+  PageHandle(PageHandle&& other) : mgr(NULL) { *this = std::move(other); }
+  ~PageHandle() { release(); }
+
+  PageHandle& operator = (PageHandle&& other)
+  {
+    if (this != &other) {
+      release();
+      mgr = other.mgr;
+      file = other.file;
+      pageNum = other.pageNum;
+      frameNo = other.frameNo;
+      pagePtr = other.pagePtr;
+      dirty = other.dirty;
+      other.mgr = NULL;
+    }
+    return *this;
+  }
+
+  PageHandle(const PageHandle&) = delete;
+  PageHandle& operator = (const PageHandle&) = delete;
+
+  bool  isPinned() const { return mgr != NULL; } // true until released
+  Page* page() const;                           // the pinned page
+  Page* operator -> () const { return page(); }
+  pageno_t pageNo() const { return pageNum; }
+  void  setDirty() { dirty = true; }            // written back when evicted
+
+  // unpins the page now instead of on destruction
+  const Status release();
+
+private:
+  void take(BufMgr* owner, File* f, const pageno_t p, const int frame, Page* pg)
+  {
+    mgr = owner;
+    file = f;
+    pageNum = p;
+    frameNo = frame;
+    pagePtr = pg;
+    dirty = false;
+  }
+
+  BufMgr* mgr;      // pool the page is pinned in, NULL if none
+  File*	  file;     // file of the page
+  pageno_t pageNum; // page within file
+  int	  frameNo;  // frame holding the page, -1 if read from a mapping
+  Page*	  pagePtr;  // the page
+  bool	  dirty;    // set by setDirty()
+};
+
+
+// The page number no page has, under which a shard's tables keep what
+// they know about a whole file.  The frames of the shard holding pages of
+// one file are chained through BufDesc::fileNext and filePrev, so that
+// flushFile finds them without a search and a miss or an eviction links
+// or unlinks a frame without allocating.
+const pageno_t FILEFRAMES = -1;
+
+// One independently latched partition of the buffer pool.  A page can
+// only ever be cached in the shard picked by BufMgr::shardOf(), so each
+// shard owns a contiguous range of frames and its own hash table, and
+// threads touching pages of different shards never contend.
+struct BufShard
+{
+  pthread_mutex_t latch;       // protects the fields below and the shard's frames
+  pthread_cond_t  readDone;    // signalled, under latch, when a page has been read in
+  int		  firstFrame;  // index of the first frame owned by the shard
+  int		  numFrames;   // number of frames owned by the shard
+  Replacer*	  replacer;    // picks victims among the shard's frames
+  std::vector<int> freeFrames; // frames holding no page, relative to firstFrame
+  int		  numUnpinned; // number of frames with a pin count of 0
+  BufHashTbl*	  hashTable;   // hash table mapping (File, page) to frame, and
+			       // (File, FILEFRAMES) to the first of the file's frames
+  BufHashTbl*	  mappedPins;  // pin counts of mapped pages, and under
+			       // (File, FILEFRAMES) the file's total
+  BufStats	  stats;       // usage statistics of the shard
+};
+
+
 class BufMgr 
 {
 private:
-  unsigned int 	 clockHand;
   int   	 numBufs;    	// Number of pages in buffer pool
-  BufHashTbl*    hashTable;  	// hash table mapping (File, page) to frame
+  int		 numShards;	// Number of partitions of the buffer pool
+  size_t	 poolBytes;	// length of the mapping holding bufPool
+  bool		 poolHuge;	// bufPool is backed by MAP_HUGETLB pages
+  BufShard*	 shards;	// the partitions, each with its own latch
   BufDesc*	 bufTable;  	// vector of status info, 1 per page
-  BufStats	 bufStats;	// buffer pool statistics
 
-  const Status allocBuf(int & frame);   // allocate a free frame.  
-  const void releaseBuf(int frame); // return unused frame to end of list
-  void advanceClock()
-  {
-	clockHand = (clockHand + 1) % numBufs;
-  }
+  pthread_t	 writer;	// background writer thread
+  bool		 writerRunning;	// true between startWriter() and stopWriter()
+  int		 writerInterval; // milliseconds between rounds
+  int		 writerPages;	// frames looked at per shard and round
+  pthread_mutex_t writerLock;	// protects writerRunning for the thread
+  pthread_cond_t writerWake;	// signalled to stop the writer early
+  pthread_cond_t writeDone;	// signalled, under writerLock, when a round's writes are done
+
+  static void* writerMain(void* mgr); // body of the writer thread
+  void cleanShard(BufShard& shard); // one writer round over a shard
+
+  pthread_t	 prefetcher;	// thread reading queued pages ahead
+  bool		 prefetcherRunning; // true once the thread has been started
+  bool		 prefetcherStop; // tells the thread to exit
+  int		 maxReadAhead;	// largest automatic readahead window, 0 if off
+  pthread_mutex_t prefetchLock;	// protects the fields below
+  pthread_cond_t prefetchWake;	// signalled when requests are queued
+  pthread_cond_t prefetchIdle;	// signalled when a request is done
+  std::deque<PageRequest> prefetchQueue; // pages waiting to be read ahead
+  const File*	 prefetchInFlight; // file of the page being read ahead, or NULL
+  std::map<const File*, ReadAhead> readAhead; // detector state per file
+
+  static void* prefetcherMain(void* mgr); // body of the prefetch thread
+  const Status loadPage(File* file, const pageno_t pageNo); // read into an unpinned frame
+  const Status loadPages(File* file, const pageno_t firstPage,
+			 const int count);  // loadPage for a run, as one batch
+  void queuePrefetch(File* file, const pageno_t firstPage, const int count); // prefetchLock held
+  void noteAccess(File* file, const pageno_t pageNo); // feeds the sequential detector
+  const Status pinPage(File* file, const pageno_t PageNo, Page*& page,
+		       BufRing* ring = NULL); // readPage without detection
+  const Status ringBuf(BufShard& shard, BufRing& ring, const File* file,
+		       const pageno_t pageNo, int& frame); // allocBuf for a ring
+
+  BufShard& shardOf(const File* file, const pageno_t pageNo) const; // shard caching a page
+  const Status allocBuf(BufShard& shard, const File* file, const pageno_t pageNo,
+			int & frame);   // allocate a frame of shard for (file, pageNo)
+  const void releaseBuf(BufShard& shard, int frame); // return a frame holding no page to the free list
+  const Status newFrame(BufShard& shard, File* file, const pageno_t pageNo,
+			int& frameNo);  // pin a new page in a zeroed frame
+  const Status mapPage(BufShard& shard, const File* file, const pageno_t pageNo,
+		       const int frame);  // enter a page in the hash table and its file's list
+  const Status unmapPage(BufShard& shard, const File* file,
+			 const pageno_t pageNo, const int frame); // remove a page from both
+  const Status findPage(BufShard& shard, const File* file, const pageno_t pageNo,
+			int& frame);   // hash table lookup, counted in the stats
+  const Status unPinFrame(const int frameNo, const File* file, const pageno_t PageNo,
+			  const bool dirty); // unPinPage for a PageHandle
+  const Status pinMapped(File* file, const pageno_t PageNo,
+			 Page* page);   // pin a page read in place from the mapping
+  const Status unPinMapped(File* file, const pageno_t PageNo,
+			   const bool dirty); // unPinPage of a mapped page
+  friend class PageHandle;
 
 
 public:
   Page*	         bufPool;   // actual buffer pool
 
-  BufMgr(const int bufs);
+  // bufs frames are split evenly over nshards latched partitions, each
+  // replacing pages according to policy; all methods may be called
+  // concurrently from several threads.  The frames are aligned for
+  // O_DIRECT; with hugePages they are backed by huge pages if the
+  // system has some reserved.
+  BufMgr(const int bufs, const int nshards = 1,
+	 const Replacement policy = CLOCK, const bool hugePages = false);
   ~BufMgr();
 
-  const Status readPage(File* file, const int PageNo, Page*& page);
-  const Status unPinPage(File* file, const int PageNo, const bool dirty);
-  const Status allocPage(File* file, int& PageNo, Page*& page); 
+  bool hugePool() const { return poolHuge; } // got the huge pages asked for
+
+  const Status readPage(File* file, const pageno_t PageNo, Page*& page);
+  // reads a page for a bulk scan, recycling the frames of ring
+  const Status readPage(File* file, const pageno_t PageNo, Page*& page, BufRing& ring);
+  const Status unPinPage(File* file, const pageno_t PageNo, const bool dirty);
+  // pins pages startPage..startPage+n-1 of file into pages[0..n-1], reading
+  // each run of consecutive misses with a single preadv
+  const Status readPages(File* file, const pageno_t startPage, const int n, Page** pages);
+  // readPage and allocPage handing out the page as a PageHandle
+  const Status readPage(File* file, const pageno_t PageNo, PageHandle& handle);
+  const Status allocPage(File* file, pageno_t& PageNo, PageHandle& handle);
+  const Status unPinPages(File* file, const pageno_t startPage, const int n, const bool dirty);
+  const Status allocPage(File* file, pageno_t& PageNo, Page*& page); 
                         // allocates a new, empty page 
+  // allocates n contiguous pages firstPageNo..firstPageNo+n-1 of file and
+  // pins them, zeroed, into pages[0..n-1] without reading them from disk
+  const Status allocPages(File* file, const int n, pageno_t& firstPageNo, Page** pages);
   const Status flushFile(const File* file); // writing out all dirty pages of the file
-  const Status disposePage(File* file, const int PageNo); // dispose of page in file
+  const Status disposePage(File* file, const pageno_t PageNo); // dispose of page in file
   void  printSelf();
 
-  const BufStats & getBufStats() const // get buffer pool usage
-  {
-	return bufStats;
-  }
-  const void clearBufStats() 
-  {
-	bufStats.clear();
-  }
+  // Starts a background writer that wakes every intervalMs milliseconds
+  // and writes back the dirty, unpinned pages among the next pagesPerRound
+  // frames of each shard the replacement policy would evict, so that
+  // readPage rarely has to wait for a write.
+  const Status startWriter(const int intervalMs, const int pagesPerRound);
+  const void stopWriter();  // stops the writer, waiting for its round to end
+
+  // Queues pages firstPage..firstPage+count-1 of file to be read into
+  // unpinned frames by a background thread, so that a later readPage of
+  // them is a hit.  Returns at once; pages already cached or beyond the
+  // end of the file are skipped.
+  const Status prefetch(File* file, const pageno_t firstPage, const int count);
+
+  // Turns the automatic readahead on (maxWindow > 0) or off (0).  Once a
+  // file is read sequentially through readPage, pages ahead of the reader
+  // are prefetched in batches that double up to maxWindow pages while the
+  // run lasts and halve whenever it breaks.
+  const void setReadAhead(const int maxWindow);
+
+  const BufStats getBufStats() const; // get buffer pool usage
+  const void clearBufStats();
 };
 
+
+inline Page* PageHandle::page() const
+{
+  return mgr ? pagePtr : NULL;
+}
+
+inline const Status PageHandle::release()
+{
+  if (!mgr)
+    return OK;
+  BufMgr* owner = mgr;
+  mgr = NULL;
+  if (frameNo < 0)
+    return owner->unPinPage(file, pageNum, dirty);
+  return owner->unPinFrame(frameNo, file, pageNum, dirty);
+}
+
 #endif
 
@@ -10,35 +10,31 @@
 
 // buffer pool hash table implementation
 
-int BufHashTbl::hash(const File* file, const int pageNo)
+int BufHashTbl::hash(const File* file, const pageno_t pageNo) const
 {
-  int tmp, value;
-  tmp = (long)file;  // cast of pointer to the file object to an integer
-  value = (tmp + pageNo) % HTSIZE;
-  return value;
+  return (int)(hashPage(file, pageNo) >> shift);
 }
 
 
-BufHashTbl::BufHashTbl(int htSize)
+BufHashTbl::BufHashTbl(int numFrames)
 {
-  HTSIZE = htSize;
-  // allocate an array of pointers to hashBuckets
-  ht = new hashBucket* [htSize];
+  // keep the load factor at or below 1/2 so probe runs stay short
+  HTSIZE = 2;
+  shift = 63;
+  while (HTSIZE < 2 * numFrames) {
+    HTSIZE *= 2;
+    shift--;
+  }
+  numEntries = 0;
+  // allocate the array of buckets, all of them empty
+  ht = new hashBucket [HTSIZE];
   for(int i=0; i < HTSIZE; i++)
-    ht[i] = NULL;
+    ht[i].file = NULL;
 }
 
 
 BufHashTbl::~BufHashTbl()
 {
-  for(int i = 0; i < HTSIZE; i++) {
-    hashBucket* tmpBuf = ht[i];
-    while (ht[i]) {
-      tmpBuf = ht[i];
-      ht[i] = ht[i]->next;
-      delete tmpBuf;
-    }
-  }
   delete [] ht;
 }
 
@@ -48,25 +44,22 @@ BufHashTbl::~BufHashTbl()
 // returns OK if OK, HASHTBLERROR if an error occurred
 //---------------------------------------------------------------
 
-Status BufHashTbl::insert(const File* file, const int pageNo, const int frameNo) {
+Status BufHashTbl::insert(const File* file, const pageno_t pageNo, const int frameNo) {
 
-  int index = hash(file, pageNo);
+  if (numEntries >= HTSIZE - 1)
+    return HASHTBLERROR;
 
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
+  int index = hash(file, pageNo);
+  while (ht[index].file) {
+    if (ht[index].file == file && ht[index].pageNo == pageNo)
       return HASHTBLERROR;
-    tmpBuc = tmpBuc->next;
+    index = (index + 1) & (HTSIZE - 1);
   }
 
-  tmpBuc = new hashBucket;
-  if (!tmpBuc)
-    return HASHTBLERROR;
-  tmpBuc->file = (File*) file;
-  tmpBuc->pageNo = pageNo;
-  tmpBuc->frameNo = frameNo;
-  tmpBuc->next = ht[index];
-  ht[index] = tmpBuc;
+  ht[index].file = file;
+  ht[index].pageNo = pageNo;
+  ht[index].frameNo = frameNo;
+  numEntries++;
 
   return OK;
 }
@@ -78,17 +71,36 @@ Status BufHashTbl::insert(const File* file, const int pageNo, const int frameNo)
 // HASHNOTFOUND
 //-------------------------------------------------------------------
 
-Status BufHashTbl::lookup(const File* file, const int pageNo, int& frameNo) 
-  {
+Status BufHashTbl::lookup(const File* file, const pageno_t pageNo, int& frameNo) const
+{
   int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
+  while (ht[index].file) {
+    if (ht[index].file == file && ht[index].pageNo == pageNo)
     {
-      frameNo = tmpBuc->frameNo; // return frameNo by reference
+      frameNo = ht[index].frameNo; // return frameNo by reference
       return OK;
     }
-    tmpBuc = tmpBuc->next;
+    index = (index + 1) & (HTSIZE - 1);
+  }
+  return HASHNOTFOUND;
+}
+
+
+//-------------------------------------------------------------------
+// change the frameNo stored for (file,pageNo); returns HASHNOTFOUND
+// if there is no such entry
+//-------------------------------------------------------------------
+
+Status BufHashTbl::update(const File* file, const pageno_t pageNo, const int frameNo)
+{
+  int index = hash(file, pageNo);
+  while (ht[index].file) {
+    if (ht[index].file == file && ht[index].pageNo == pageNo)
+    {
+      ht[index].frameNo = frameNo;
+      return OK;
+    }
+    index = (index + 1) & (HTSIZE - 1);
   }
   return HASHNOTFOUND;
 }
@@ -97,27 +109,39 @@ Status BufHashTbl::lookup(const File* file, const int pageNo, int& frameNo)
 //-------------------------------------------------------------------
 // delete entry (file,pageNo) from hash table. REturn OK if page was
 // found.  Else return HASHTBLERROR
+//
+// The buckets following the removed one are shifted back into the
+// hole as long as that brings them no earlier than their home slot,
+// so every remaining entry stays reachable without tombstones.
 //-------------------------------------------------------------------
 
-Status BufHashTbl::remove(const File* file, const int pageNo) {
+Status BufHashTbl::remove(const File* file, const pageno_t pageNo) {
 
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  hashBucket* prevBuc = ht[index];
-
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo) {
-      if (tmpBuc == ht[index]) 
-	ht[index] = tmpBuc->next;
-      else
-	prevBuc->next = tmpBuc->next;
-      delete tmpBuc;
-      return OK;
-    } else {
-      prevBuc = tmpBuc;
-      tmpBuc = tmpBuc->next;
+  const int mask = HTSIZE - 1;
+  int hole = hash(file, pageNo);
+  while (ht[hole].file) {
+    if (ht[hole].file == file && ht[hole].pageNo == pageNo)
+      break;
+    hole = (hole + 1) & mask;
+  }
+  if (!ht[hole].file)
+    return HASHTBLERROR;
+
+  int next = hole;
+  while (true) {
+    next = (next + 1) & mask;
+    if (!ht[next].file)
+      break;
+    // an entry may move into the hole unless its home slot lies
+    // cyclically in (hole, next]
+    int home = hash(ht[next].file, ht[next].pageNo);
+    if (((next - home) & mask) >= ((next - hole) & mask)) {
+      ht[hole] = ht[next];
+      hole = next;
     }
   }
+  ht[hole].file = NULL;
+  numEntries--;
 
-  return HASHTBLERROR;
+  return OK;
 }
@@ -3,12 +3,17 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include <iostream>
 #include <math.h>
 #include <stdio.h>
 #include "page.h"
 #include "db.h"
 #include "buf.h"
+#include "io.h"
 
 
 #define DBP(p)      (*(DBPage*)&p)
@@ -131,25 +136,39 @@ File::File(const string & fname)
   fileName = fname;
   openCnt = 0;
   unixFile = -1;
+  holePages = 0;
+  direct = false;
+  mapping = NULL;
+  mappedPages = 0;
+  mapLength = 0;
+  headerDirty = false;
+  freeHint = 0;
+  mapDirDirty = false;
+  headerSync = 0;
+  headerUpdates = 0;
+  headerIOSaved = 0;
+  pthread_mutex_init(&hdrLatch, NULL);
 }
 
 // Deallocate a file object
 File::~File()
 {
-  if (openCnt == 0)
-    return;
-
-  // This means that file must be closed down if open
-  // and buffer pages flushed.
-  // To ensure that all this happens, must push down the openCnt to 1.
-  openCnt = 1;
-
-  Status status = close();
-  if (status != OK)
+  if (openCnt != 0)
     {
-      Error error;
-      error.print(status);
+      // This means that file must be closed down if open
+      // and buffer pages flushed.
+      // To ensure that all this happens, must push down the openCnt to 1.
+      openCnt = 1;
+
+      Status status = close();
+      if (status != OK)
+	{
+	  Error error;
+	  error.print(status);
+	}
     }
+
+  pthread_mutex_destroy(&hdrLatch);
 }
 
 Status const File::create(const string & fileName)
@@ -170,6 +189,7 @@ Status const File::create(const string & fileName)
   DBP(header).nextFree = -1;
   DBP(header).firstPage = -1;
   DBP(header).numPages = 1;
+  DBP(header).pageSize = PAGESIZE;
   if (write(file, (char*)&header, sizeof header) != sizeof header)
     return UNIXERR;
 
@@ -190,25 +210,139 @@ const Status File::destroy(const string & fileName)
   return OK;
 }
 
-const Status File::open()
+const Status File::open(const int mode)
 {
+  // With smaller pages most frames of the buffer pool would be off a
+  // DIRECTALIGN boundary, and every transfer of one would be bounced.
+
+  if ((mode & DIRECT) && PAGESIZE % DIRECTALIGN != 0)
+    return BADPAGESIZE;
+
   // Open file -- it will be closed in closeFile().
 
   if (openCnt == 0)
     {
-      if ((unixFile = ::open(fileName.c_str(), O_RDWR)) < 0)
+      direct = (mode & DIRECT) != 0;
+      if ((unixFile = ::open(fileName.c_str(),
+			     O_RDWR | (direct ? O_DIRECT : 0))) < 0)
 	return UNIXERR;
 
+      // Keep the header page in memory until the file is closed.  Its
+      // read doubles as the check that the file system takes O_DIRECT
+      // transfers of PAGESIZE bytes.  A file too short to hold it was
+      // made with smaller pages.
+
+      struct stat statusBuf;
+      Status status = OK;
+      if (fstat(unixFile, &statusBuf) < 0)
+	status = UNIXERR;
+      else if (statusBuf.st_size < (off_t)sizeof(Page))
+	status = BADPAGESIZE;
+      Page hdrPage;
+      if (status == OK)
+	status = intread(0, &hdrPage);
+      holePages = statusBuf.st_blksize > (blksize_t)sizeof(Page)
+	? statusBuf.st_blksize / sizeof(Page) : 1;
+      if (status != OK) {
+	::close(unixFile);
+	unixFile = -1;
+	return status;
+      }
+      headerDirty = false;
+      headerUpdates = 0;
+      headerIOSaved = 0;
+      if ((status = loadHeader(hdrPage)) != OK
+	  || (status = loadFreeMap()) != OK) {
+	::close(unixFile);
+	unixFile = -1;
+	return status;
+      }
+
       // Store file info in open files table.
 
       openCnt = 1;
     }
-  else
+  else {
+    // A DIRECT open of a file already open buffered switches the shared
+    // descriptor over; the reverse leaves it direct.
+
+    if ((mode & DIRECT) && !direct) {
+      int flags = fcntl(unixFile, F_GETFL);
+      if (flags < 0 || fcntl(unixFile, F_SETFL, flags | O_DIRECT) < 0)
+	return UNIXERR;
+      direct = true;
+    }
     openCnt++;
+  }
+
+  // A file already open may have pages in the buffer pool, which would
+  // be newer than the mapping and could no longer be unpinned once reads
+  // and unpins of them went to it.  They are flushed first, and the
+  // open fails if one of them is pinned.
+
+  if ((mode & MAPPED) && !mapping) {
+    Status status = OK;
+    if (openCnt > 1 && bufMgr)
+      status = bufMgr->flushFile(this);
+    if (status == OK)
+      status = map();
+    if (status != OK && openCnt > 1)
+      openCnt--;
+    return status;
+  }
 
   return OK;
 }
 
+
+// Map the pages the file has now read-only. BufMgr serves reads of
+// these pages straight from the mapping instead of copying them into
+// the buffer pool; pages allocated later go through the pool as usual.
+// Pages in the mapping that are freed are not handed out again while
+// it lasts, since BufMgr would go on reading them from it. The mapping
+// is shared, so pages written with writePage show through.
+
+const Status File::map()
+{
+  pthread_mutex_lock(&hdrLatch);
+  pageno_t numPages = header.numPages;
+  pthread_mutex_unlock(&hdrLatch);
+
+  void* addr = mmap(NULL, (size_t)numPages * sizeof(Page), PROT_READ,
+		    MAP_SHARED, unixFile, 0);
+  if (addr == MAP_FAILED)
+    return UNIXERR;
+  mapping = (char*)addr;
+  mappedPages = numPages;
+  mapLength = (size_t)numPages * sizeof(Page);
+
+  return OK;
+}
+
+
+// Return the address of pageNo in the read-only mapping, or NULL if
+// the file is not mapped or the page was allocated after mapping it.
+
+Page* File::mappedPage(const pageno_t pageNo) const
+{
+  if (!mapping || pageNo < 1 || pageNo >= mappedPages)
+    return NULL;
+  return (Page*)(mapping + (size_t)pageNo * sizeof(Page));
+}
+
+
+// Ask the kernel to start reading the mapped ones among count pages
+// from firstPage, the mapping's equivalent of a prefetch.
+
+void File::willNeed(const pageno_t firstPage, const int count) const
+{
+  pageno_t last = firstPage + count < mappedPages ? firstPage + count : mappedPages;
+  if (!mapping || firstPage < 1 || firstPage >= last)
+    return;
+  (void)madvise(mapping + (size_t)firstPage * sizeof(Page),
+		(size_t)(last - firstPage) * sizeof(Page), MADV_WILLNEED);
+}
+
 const Status File::close()
 {
   if (openCnt <= 0)
@@ -223,6 +357,18 @@ const Status File::close()
     if (bufMgr)
       bufMgr->flushFile(this);
 
+    Status status = syncHeader();
+    if (status != OK)
+      return status;
+
+    if (mapping) {
+      munmap(mapping, mapLength);
+      mapping = NULL;
+      mappedPages = 0;
+      mapLength = 0;
+    }
+
+    direct = false;
     if (::close(unixFile) < 0)
       return UNIXERR;
   }
@@ -231,52 +377,57 @@ const Status File::close()
 }
 
 
-// Allocate a page either from a free list (list of pages which
-// were previously disposed of), or extend file if no free pages
-// are available.
+// Allocate a page either from the free-space map (pages which were
+// previously disposed of), or extend file if no free pages are
+// available.
 
-Status File::allocatePage(int& pageNo)
+Status File::allocatePage(pageno_t& pageNo)
 {
-  Page header;
-  Status status;
+  pthread_mutex_lock(&hdrLatch);
+  Status status = intallocate(pageNo);
+  pthread_mutex_unlock(&hdrLatch);
+  return status;
+}
 
-  if ((status = intread(0, &header)) != OK)
-    return status;
+// Allocate a page, the caller holds hdrLatch.
 
-  // If free list has pages on it, take one from there
-  // and adjust free list accordingly.
+const Status File::intallocate(pageno_t& pageNo)
+{
+  Status status;
 
-  if (DBP(header).nextFree != -1) {     // free list exists?
+  headerIOSaved++;                      // header read from memory
 
-    // Return first page on free list to the caller,
-    // adjust free list accordingly.
+  // If there are free pages, take the lowest one. This is a memory
+  // operation: the page itself is neither read nor written, so it holds
+  // its old contents, or zeros if its blocks were punched out.
 
-    pageNo = DBP(header).nextFree;
-    Page firstFree;
-    if ((status = intread(pageNo, &firstFree)) != OK)
-      return status;
-    DBP(header).nextFree = DBP(firstFree).nextFree;
+  pageNo = header.numFree > 0 ? findFree(1) : -1;
+  if (pageNo >= 0) {
+
+    setFree(pageNo, false);
+    header.numFree--;
 
-  } else {                              // no free list, have to extend file
+  } else {                              // no free pages, have to extend file
 
     // Extend file -- the current number of pages will be
     // the page number of the page to be returned.
 
-    pageNo = DBP(header).numPages;
+    pageNo = header.numPages;
     Page newPage;
     memset(&newPage, 0, sizeof newPage);
     if ((status = intwrite(pageNo, &newPage)) != OK)
       return status;
 
-    DBP(header).numPages++;
+    header.numPages++;
+    freeMap.resize((header.numPages + 7) / 8, 0);
 
-    if (DBP(header).firstPage == -1)    // first user page in file?
-      DBP(header).firstPage = pageNo;
+    if (header.firstPage == -1)         // first user page in file?
+      header.firstPage = pageNo;
   }
 
-  if ((status = intwrite(0, &header)) != OK)
+  if ((status = headerChanged()) != OK)
     return status;
-  
+
 #ifdef DEBUGFREE
   listFree();
 #endif
@@ -285,41 +436,95 @@ Status File::allocatePage(int& pageNo)
 }
 
 
-// Deallocate a page from file. The page will be put on a free
-// list and returned back to the caller upon a subsequent
+// Allocate n contiguous pages and return the number of the first.
+// A run of n free pages is used if there is one; otherwise the file is
+// extended, taking over any free pages at its end. The extension is
+// reserved with a single fallocate, or ftruncate where the file system
+// does not support it; either way the new pages read back as zeros.
+// Reused free pages keep their old contents.
+
+const Status File::allocatePages(const int n, pageno_t& firstPageNo)
+{
+  if (n < 1)
+    return BADPAGENO;
+
+  pthread_mutex_lock(&hdrLatch);
+  headerIOSaved++;                      // header read from memory
+  Status status = OK;
+  firstPageNo = header.numFree >= n ? findFree(n) : -1;
+  pageno_t reused = n;
+  if (firstPageNo < 0) {
+    // count the free pages the file ends with, past the mapping
+    for (reused = 0; reused < header.numPages - 1
+	   && header.numPages - 1 - reused >= mappedPages
+	   && isFree(header.numPages - 1 - reused); reused++) ;
+    firstPageNo = header.numPages - reused;
+    off_t offset = (off_t)header.numPages * sizeof(Page);
+    off_t length = (off_t)(n - reused) * sizeof(Page);
+    if (fallocate(unixFile, 0, offset, length) < 0
+	&& (errno != EOPNOTSUPP || ftruncate(unixFile, offset + length) < 0))
+      status = UNIXERR;
+  }
+
+  if (status == OK) {
+    for (pageno_t i = 0; i < reused; i++)
+      setFree(firstPageNo + i, false);
+    header.numFree -= reused;
+    if (firstPageNo + n > header.numPages) {
+      header.numPages = firstPageNo + n;
+      freeMap.resize((header.numPages + 7) / 8, 0);
+    }
+    if (header.firstPage == -1)         // first user page in file?
+      header.firstPage = firstPageNo;
+    status = headerChanged();
+  }
+  pthread_mutex_unlock(&hdrLatch);
+
+  return status;
+}
+
+
+// Deallocate a page from file. The page is marked free in the
+// free-space map and returned back to the caller upon a subsequent
 // allocPage() call.
 
-const Status File::disposePage(const int pageNo)
+const Status File::disposePage(const pageno_t pageNo)
 {
   if (pageNo < 1)
     return BADPAGENO;
 
-  Page header;
+  pthread_mutex_lock(&hdrLatch);
+  Status status = intdispose(pageNo);
+  pthread_mutex_unlock(&hdrLatch);
+  return status;
+}
+
+// Deallocate a page, the caller holds hdrLatch.
+
+const Status File::intdispose(const pageno_t pageNo)
+{
   Status status;
 
-  if ((status = intread(0, &header)) != OK)
-    return status;
+  headerIOSaved++;                      // header read from memory
 
   // The first user-allocated page in the file cannot be
   // disposed of. The File layer has no knowledge of what
   // is the next page in the file and hence would not be
   // able to adjust the firstPage field in file header.
+  // Neither can a page that is already free, or a map page.
 
-  if (DBP(header).firstPage == pageNo || pageNo >= DBP(header).numPages)
+  if (header.firstPage == pageNo || pageNo >= header.numPages
+      || isFree(pageNo) || isMapPage(pageNo))
     return BADPAGENO;
 
-  // Deallocate page by attaching it to the free list.
+  // Deallocate page by setting its bit in the map; nothing is
+  // written until the header is.
 
-  Page away;
-  if ((status = intread(pageNo, &away)) != OK)
+  if ((status = markFree(pageNo)) != OK)
     return status;
-  memset(&away, 0, sizeof away);
-  DBP(away).nextFree = DBP(header).nextFree;
-  DBP(header).nextFree = pageNo;
-
-  if ((status = intwrite(pageNo, &away)) != OK)
+  if ((status = headerChanged()) != OK)
     return status;
-  if ((status = intwrite(0, &header)) != OK)
+  if (isFree(pageNo) && (status = punch(pageNo)) != OK)
     return status;
 
 #ifdef DEBUGFREE
@@ -330,61 +535,599 @@ const Status File::disposePage(const int pageNo)
 }
 
 
-// Read a page from file and store page contents at the page address
-// provided by the caller.
+// Add pageNo to the free-space map. If its range has no map page yet,
+// pageNo itself becomes that map page instead of a free page, so the
+// map never grows the file. If listing that map page would take another
+// directory page, pageNo becomes the directory page instead, and the
+// next page disposed of in its range the map page. The caller holds
+// hdrLatch.
 
-const Status File::intread(int pageNo, Page* pagePtr) const
+const Status File::markFree(const pageno_t pageNo)
 {
-  if (lseek(unixFile, pageNo * sizeof(Page), SEEK_SET) == -1)
-    return UNIXERR;
+  size_t k = pageNo / MAPBITS;
+
+  if (k >= mapPages.size()) {
+    mapPages.resize(k + 1, 0);
+    mapDirty.resize(k + 1, false);
+  }
+  if (mapPages[k] == 0) {
+    mapPages[k] = pageNo;
+    if (dirPagesNeeded() > mapDir.size()) {
+      mapPages[k] = 0;
+      mapDir.push_back(pageNo);
+    }
+    mapDirDirty = true;
+  } else {
+    setFree(pageNo, true);
+    header.numFree++;
+  }
+  mapDirty[k] = true;
+  return OK;
+}
+
 
-  int nbytes = read(unixFile, (char*)pagePtr, sizeof(Page));
+// Test whether pageNo is a map page or a directory page. Neither can be
+// disposed of.
+
+bool File::isMapPage(const pageno_t pageNo) const
+{
+  size_t k = pageNo / MAPBITS;
+  if (k < mapPages.size() && mapPages[k] == pageNo)
+    return true;
+  for (size_t i = 0; i < mapDir.size(); i++)
+    if (mapDir[i] == pageNo)
+      return true;
+  return false;
+}
+
+
+// Return the number of directory pages it takes to list the map pages
+// the header has no room for: none while they all fit in it, otherwise
+// enough for every map page from the header's last entry on.
+
+size_t File::dirPagesNeeded() const
+{
+  size_t n = mapPages.size();
+  while (n > 0 && mapPages[n - 1] == 0)
+    n--;
+  if (n <= (size_t)MAXMAPPAGES)
+    return 0;
+
+  size_t listed = 0;
+  for (size_t k = MAXMAPPAGES - 1; k < n; k++)
+    if (mapPages[k] != 0)
+      listed++;
+  return (listed + DIRENTRIES - 1) / DIRENTRIES;
+}
+
+
+// Give the disk blocks of free page pageNo back to the file system by
+// punching a hole, which reads back as zeros. A block can only go once
+// all the pages in it are free, so with pages smaller than a block the
+// whole block is punched when its last page is disposed of. Where the
+// file system cannot punch holes, disposed pages keep their space until
+// compact(). The caller holds hdrLatch.
+
+const Status File::punch(const pageno_t pageNo)
+{
+  if (holePages == 0)
+    return OK;
+
+  pageno_t first = pageNo / holePages * holePages;
+  pageno_t last = first + holePages;
+  if (last > header.numPages)
+    last = header.numPages;
+  for (pageno_t p = first; p < last; p++)
+    if (!isFree(p))
+      return OK;
+
+  if (fallocate(unixFile, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+		(off_t)first * sizeof(Page),
+		(off_t)(last - first) * sizeof(Page)) < 0) {
+    if (errno != EOPNOTSUPP)
+      return UNIXERR;
+    holePages = 0;
+  }
+  return OK;
+}
+
+
+// Truncate the run of free pages the file ends with, giving their
+// space back and taking them out of the free-space map. A map page in
+// that run moves to the lowest free page left in its range, or goes if
+// there is none. A directory page in it goes if the directory can do
+// without it, and otherwise moves to the lowest free page. The header is written before the file is cut, so a
+// crash in between only leaves unused pages past the end, which the
+// next extension overwrites.
+
+const Status File::compact()
+{
+  pthread_mutex_lock(&hdrLatch);
+  headerIOSaved++;                      // header read from memory
+  pageno_t end = header.numPages;
+  for (;;) {
+    while (end > 1 && isFree(end - 1))
+      end--;
+    if (end <= 1)
+      break;
+    pageno_t last = end - 1;
+    size_t k = last / MAPBITS;
+    if (k < mapPages.size() && mapPages[k] == last) {
+      mapPages[k] = 0;
+      for (pageno_t p = (pageno_t)k * MAPBITS; p < last; p++)
+	if (isFree(p)) {
+	  setFree(p, false);
+	  header.numFree--;
+	  mapPages[k] = p;
+	  break;
+	}
+      mapDirty[k] = true;
+    } else {
+      size_t d = 0;
+      while (d < mapDir.size() && mapDir[d] != last)
+	d++;
+      if (d == mapDir.size())
+	break;
+      if (mapDir.size() > dirPagesNeeded())
+	mapDir.erase(mapDir.begin() + d);
+      else {
+	pageno_t p = findFree(1);
+	if (p < 0 || p >= last)
+	  break;
+	setFree(p, false);
+	header.numFree--;
+	mapDir[d] = p;
+      }
+    }
+    mapDirDirty = true;
+    end--;
+  }
+  while (!mapPages.empty() && mapPages.back() == 0) {
+    mapPages.pop_back();
+    mapDirty.pop_back();
+  }
+
+  Status status = OK;
+  if (end < header.numPages) {
+    for (pageno_t p = end; p < header.numPages; p++)
+      if (isFree(p)) {
+	setFree(p, false);
+	header.numFree--;
+      }
+    header.numPages = end;
+    freeMap.resize((end + 7) / 8);
+    if ((status = headerChanged()) == OK)
+      status = writeHeader();
+    if (status == OK && ftruncate(unixFile, (off_t)end * sizeof(Page)) < 0)
+      status = UNIXERR;
+    if (status == OK && mappedPages > end) {
+      // Pages past the end are no longer served from the mapping.  Only
+      // whole system pages of it can be unmapped, so with smaller pages
+      // the last few cut off may stay mapped until close.
+      mappedPages = end;
+      size_t sysPage = sysconf(_SC_PAGESIZE);
+      size_t keep = ((size_t)end * sizeof(Page) + sysPage - 1) / sysPage * sysPage;
+      if (keep < mapLength) {
+	if (munmap(mapping + keep, mapLength - keep) < 0)
+	  status = UNIXERR;
+	else
+	  mapLength = keep;
+      }
+    }
+  }
+  pthread_mutex_unlock(&hdrLatch);
+
+  return status;
+}
+
+
+// Test whether pageNo is marked free.
+
+bool File::isFree(const pageno_t pageNo) const
+{
+  return (freeMap[pageNo / 8] >> (pageNo % 8)) & 1;
+}
+
+
+// Mark pageNo free or in use, noting that its map page has changed.
+// The caller holds hdrLatch.
+
+void File::setFree(const pageno_t pageNo, const bool free)
+{
+  if (free) {
+    freeMap[pageNo / 8] |= 1 << (pageNo % 8);
+    if ((size_t)(pageNo / 8) < freeHint)
+      freeHint = pageNo / 8;
+  } else {
+    freeMap[pageNo / 8] &= ~(1 << (pageNo % 8));
+    while (freeHint < freeMap.size() && freeMap[freeHint] == 0)
+      freeHint++;
+  }
+  mapDirty[pageNo / MAPBITS] = true;
+}
+
+
+// Return the first page of the lowest run of n free pages outside the
+// mapping, or -1 if there is none. Bytes with no free page are skipped
+// whole.
+
+pageno_t File::findFree(const int n) const
+{
+  int run = 0;
+  size_t first = freeHint;
+  if ((size_t)(mappedPages / 8) > first)
+    first = mappedPages / 8;
+  for (size_t byte = first; byte < freeMap.size(); byte++) {
+    if (freeMap[byte] == 0) {
+      run = 0;
+      continue;
+    }
+    for (int bit = 0; bit < 8; bit++) {
+      if (!((freeMap[byte] >> bit) & 1)
+	  || (pageno_t)byte * 8 + bit < mappedPages) {
+	run = 0;
+	continue;
+      }
+      if (++run == n)
+	return (pageno_t)byte * 8 + bit - n + 1;
+    }
+  }
+  return -1;
+}
+
+
+// Take the header from the page read when the file is opened, checking
+// that the file was created with this build's PAGESIZE.  Older headers
+// are moved to the current layout, in memory and on the next write:
+//
+//  - until page numbers were 64 bits, they were the int fields up
+//    front, followed by numMaps, pageSize and mapPages as ints;
+//  - before that, files had 1K pages and no pageSize, mapPages starting
+//    where pageSize is now.  In that layout the entry past the last map
+//    page in use is 0, while with pageSize the last one in use never is.
+
+const Status File::loadHeader(const Page& hdrPage)
+{
+  header = DBP(hdrPage);
+  if (header.oldNumPages == 0)
+    return header.pageSize == (int)PAGESIZE ? OK : BADPAGESIZE;
+
+  const int* old = (const int*)&hdrPage;
+  const int maxOldMaps = (PAGESIZE - 7 * sizeof(int)) / sizeof(int);
+  int numMaps = old[4];
+  int pageSize = old[5];
+  const int* oldMaps = old + 6;
+  if (numMaps == 0 ? pageSize == 0
+      : numMaps <= maxOldMaps && oldMaps[numMaps - 1] == 0) {
+    pageSize = 1024;
+    oldMaps = old + 5;
+  }
+  if (pageSize != (int)PAGESIZE)
+    return BADPAGESIZE;
+  if (numMaps > MAXMAPPAGES)
+    return FILEHDRFULL;
+
+  header.firstPage = old[1];
+  header.numPages = old[2];
+  header.numFree = old[3];
+  header.oldFirstPage = header.oldNumPages = header.oldNumFree = 0;
+  header.pageSize = PAGESIZE;
+  for (int k = 0; k < MAXMAPPAGES; k++)
+    header.mapPages[k] = k < numMaps ? oldMaps[k] : 0;
+  headerDirty = true;
+  return OK;
+}
+
+
+// Read the free-space map from its map pages when the file is opened,
+// finding those the header has no room for through the directory.
+// A file written before the map existed keeps its free pages on a
+// linked list through nextFree; the list is walked once and converted.
+
+const Status File::loadFreeMap()
+{
+  Status status;
+
+  freeMap.assign((header.numPages + 7) / 8, 0);
+  freeHint = 0;
+  mapPages.assign(header.numMaps, 0);
+  mapDir.clear();
+  mapDirDirty = false;
+
+  Page mapPage;
+  if (header.numMaps <= MAXMAPPAGES)
+    for (int k = 0; k < header.numMaps; k++)
+      mapPages[k] = header.mapPages[k];
+  else {
+    for (int k = 0; k < MAXMAPPAGES - 1; k++)
+      mapPages[k] = header.mapPages[k];
+    for (pageno_t dirNo = header.mapPages[MAXMAPPAGES - 1]; dirNo != 0; ) {
+      mapDir.push_back(dirNo);
+      if ((status = intread(dirNo, &mapPage)) != OK)
+	return status;
+      const pageno_t* listed = (const pageno_t*)&mapPage;
+      for (int i = 0; i < DIRENTRIES && listed[i] != 0; i++)
+	if ((size_t)(listed[i] / MAPBITS) < mapPages.size())
+	  mapPages[listed[i] / MAPBITS] = listed[i];
+      dirNo = listed[DIRENTRIES];
+    }
+  }
+  while (!mapPages.empty() && mapPages.back() == 0)
+    mapPages.pop_back();
+  mapDirty.assign(mapPages.size(), false);
+
+  for (size_t k = 0; k < mapPages.size(); k++) {
+    if (mapPages[k] == 0)
+      continue;
+    if ((status = intread(mapPages[k], &mapPage)) != OK)
+      return status;
+    size_t first = k * (MAPBITS / 8);
+    size_t last = first + MAPBITS / 8;
+    if (last > freeMap.size())
+      last = freeMap.size();
+    if (first < last)
+      memcpy(&freeMap[first], &mapPage, last - first);
+  }
+
+  if (header.nextFree != -1) {
+    vector<int> freeList;
+    for (int pageNo = header.nextFree; pageNo != -1; ) {
+      freeList.push_back(pageNo);
+      Page away;
+      if ((status = intread(pageNo, &away)) != OK)
+	return status;
+      pageNo = DBP(away).nextFree;
+    }
+    header.nextFree = -1;
+    for (int i = 0; i < (int)freeList.size(); i++)
+      if ((status = markFree(freeList[i])) != OK)
+	return status;
+    headerDirty = true;
+  }
+
+  return OK;
+}
+
+
+// Record a change to the cached header. It is written back when the
+// file is flushed or closed, or, if setHeaderSync() asked for it, once
+// enough changes have piled up. The caller holds hdrLatch.
+
+const Status File::headerChanged()
+{
+  headerDirty = true;
+  headerIOSaved++;                      // header write deferred
+  if (headerSync > 0 && ++headerUpdates >= headerSync)
+    return writeHeader();
+  return OK;
+}
+
+
+// Write the changed map pages and, if map pages have come, gone or
+// moved, the directory, then the cached header to page 0 if it has
+// changed. The caller holds hdrLatch.
+
+const Status File::writeHeader()
+{
+  Status status;
+
+  for (size_t k = 0; k < mapPages.size(); k++) {
+    if (!mapDirty[k] || mapPages[k] == 0)
+      continue;
+    Page mapPage;
+    memset(&mapPage, 0, sizeof mapPage);
+    size_t first = k * (MAPBITS / 8);
+    size_t last = first + MAPBITS / 8;
+    if (last > freeMap.size())
+      last = freeMap.size();
+    if (first < last)
+      memcpy(&mapPage, &freeMap[first], last - first);
+    if ((status = intwrite(mapPages[k], &mapPage)) != OK)
+      return status;
+    mapDirty[k] = false;
+  }
+
+  if (mapDirDirty) {
+    // With a directory, the header's last entry is its first page, and
+    // the map pages from there on are listed in it.
+    size_t n = mapPages.size();
+    while (n > 0 && mapPages[n - 1] == 0)
+      n--;
+    size_t inHeader = mapDir.empty() ? MAXMAPPAGES : MAXMAPPAGES - 1;
+    size_t k = inHeader;
+    for (size_t i = 0; i < mapDir.size(); i++) {
+      Page dirPage;
+      memset(&dirPage, 0, sizeof dirPage);
+      pageno_t* listed = (pageno_t*)&dirPage;
+      for (int entry = 0; entry < DIRENTRIES && k < n; k++)
+	if (mapPages[k] != 0)
+	  listed[entry++] = mapPages[k];
+      listed[DIRENTRIES] = i + 1 < mapDir.size() ? mapDir[i + 1] : 0;
+      if ((status = intwrite(mapDir[i], &dirPage)) != OK)
+	return status;
+    }
+    for (k = 0; k < (size_t)MAXMAPPAGES; k++)
+      header.mapPages[k] = k < inHeader && k < n ? mapPages[k] : 0;
+    if (!mapDir.empty()) {
+      header.mapPages[MAXMAPPAGES - 1] = mapDir[0];
+      if (n <= (size_t)MAXMAPPAGES)
+	n = MAXMAPPAGES + 1;
+    }
+    header.numMaps = n;
+    headerDirty = true;
+    mapDirDirty = false;
+  }
+
+  if (!headerDirty)
+    return OK;
+
+  Page hdrPage;
+  memset(&hdrPage, 0, sizeof hdrPage);
+  DBP(hdrPage) = header;
+  if ((status = intwrite(0, &hdrPage)) != OK)
+    return status;
+  headerDirty = false;
+  headerUpdates = 0;
+  headerIOSaved--;                      // one deferred write was paid for
+  return OK;
+}
+
+
+// Write the cached header to page 0 if it has changed. BufMgr::flushFile
+// and the final close call this; callers wanting a sync point of their
+// own may call it at any time.
+
+const Status File::syncHeader()
+{
+  pthread_mutex_lock(&hdrLatch);
+  Status status = writeHeader();
+  pthread_mutex_unlock(&hdrLatch);
+  return status;
+}
+
+
+// Write the header every updates changes to it, in addition to flushes
+// and closes, bounding how many allocations a crash can lose. 0 (the
+// default) writes it only on flush and close.
+
+void File::setHeaderSync(const int updates)
+{
+  pthread_mutex_lock(&hdrLatch);
+  headerSync = updates > 0 ? updates : 0;
+  pthread_mutex_unlock(&hdrLatch);
+}
+
+
+// Return the number of header page reads and writes that the cached
+// header has saved since the file was opened.
+
+long File::getHeaderIOSaved() const
+{
+  pthread_mutex_lock(&hdrLatch);
+  long saved = headerIOSaved;
+  pthread_mutex_unlock(&hdrLatch);
+  return saved;
+}
+
+
+// Transfer the pages of count (pageNo, page) pairs, in the order given,
+// through the selected I/O backend. Entries for adjacent pages in
+// ascending order are gathered into a single request of up to IOV_MAX
+// pages, and all the requests are submitted as one batch, so that a
+// backend able to overlap them has every run in flight at once.
+
+static const Status transferPages(const int unixFile, const bool write,
+				  const PageIO* pages, const int count,
+				  const bool direct)
+{
+  if (count == 0)
+    return OK;
+
+  // O_DIRECT rejects buffers off a DIRECTALIGN boundary.  Every frame of
+  // the buffer pool is on one, since DIRECT needs PAGESIZE to be a
+  // multiple of DIRECTALIGN, so this is only for pages kept elsewhere,
+  // such as on the stack.
+
+  vector<Page*> bounce(count, (Page*)NULL);
+  if (direct) {
+    for (int i = 0; i < count; i++) {
+      if (((size_t)pages[i].page) % DIRECTALIGN == 0)
+	continue;
+      void* buf;
+      if (posix_memalign(&buf, DIRECTALIGN, sizeof(Page)) != 0) {
+	for (int j = 0; j < i; j++) free(bounce[j]);
+	return UNIXERR;
+      }
+      bounce[i] = (Page*)buf;
+      if (write)
+	memcpy(bounce[i], pages[i].page, sizeof(Page));
+    }
+  }
+
+  vector<struct iovec> iov(count);
+  vector<IORequest> requests;
+  for (int done = 0; done < count; ) {
+    int n = 0;
+    do {
+      iov[done + n].iov_base = bounce[done + n] ? bounce[done + n]
+					        : pages[done + n].page;
+      iov[done + n].iov_len = sizeof(Page);
+      n++;
+    } while (done + n < count && n < IOV_MAX
+	     && pages[done + n].pageNo == pages[done].pageNo + n);
+
+    IORequest request;
+    request.fd = unixFile;
+    request.write = write;
+    request.offset = (off_t)pages[done].pageNo * sizeof(Page);
+    request.iov = &iov[done];
+    request.iovcnt = n;
+    request.length = n * sizeof(Page);
+    requests.push_back(request);
+    done += n;
+  }
+
+  IOBatch batch;
+  IOBackend::get()->submit(&requests[0], requests.size(), batch);
+  Status status = batch.wait();
+
+  for (int i = 0; i < count; i++) {
+    if (!bounce[i])
+      continue;
+    if (!write && status == OK)
+      memcpy(pages[i].page, bounce[i], sizeof(Page));
+    free(bounce[i]);
+  }
+  return status;
+}
+
+
+// Read a page from file and store page contents at the page address
+// provided by the caller. The read is positional, so any number of
+// threads can read the file at once.
+
+const Status File::intread(const pageno_t pageNo, Page* pagePtr) const
+{
+  PageIO io = { pageNo, pagePtr };
+  Status status = transferPages(unixFile, false, &io, 1, direct);
 
 #ifdef DEBUGIO
-  cerr << "%%  File " << (int)this << ": read bytes ";
-  cerr << pageNo * sizeof(Page) << ":+" << nbytes << endl;
+  cerr << "%%  File " << (int)this << ": read page ";
+  cerr << pageNo << ": " << status << endl;
   cerr << "%%  ";
   for(int i = 0; i < 10; i++)
     cerr << *((int*)pagePtr + i) << " ";
   cerr << endl;
 #endif
 
-  if (nbytes != sizeof(Page))
-    return UNIXERR;
-
-  return OK;
+  return status;
 }
 
 
 // Write a page to file. Page data is at the page address
 // provided by the caller.
 
-const Status File::intwrite(const int pageNo, const Page* pagePtr)
+const Status File::intwrite(const pageno_t pageNo, const Page* pagePtr)
 {
-  if (lseek(unixFile, pageNo * sizeof(Page), SEEK_SET) == -1)
-    return UNIXERR;
-
-  int nbytes = write(unixFile, (char*)pagePtr, sizeof(Page));
+  PageIO io = { pageNo, (Page*)pagePtr };
+  Status status = transferPages(unixFile, true, &io, 1, direct);
 
 #ifdef DEBUGIO
-  cerr << "%%  File " << (int)this << ": wrote bytes ";
-  cerr << pageNo * sizeof(Page) << ":+" << nbytes << endl;
+  cerr << "%%  File " << (int)this << ": wrote page ";
+  cerr << pageNo << ": " << status << endl;
   cerr << "%%  ";
   for(int i = 0; i < 10; i++)
     cerr << *((int*)pagePtr + i) << " ";
   cerr << endl;
 #endif
 
-  if (nbytes != sizeof(Page))
-    return UNIXERR;
-
-  return OK;
+  return status;
 }
 
 
 // Read a page from file, check parameters for validity.
 
-const Status File::readPage(const int pageNo, Page* pagePtr) const
+const Status File::readPage(const pageno_t pageNo, Page* pagePtr) const
 {
   if (!pagePtr)
     return BADPAGEPTR;
@@ -395,9 +1138,85 @@ const Status File::readPage(const int pageNo, Page* pagePtr) const
 }
 
 
+// Read count consecutive pages starting at firstPage into the pages
+// pointed to by pagePtrs, which need not be adjacent in memory.
+
+const Status File::readPages(const pageno_t firstPage, const int count,
+			     Page** pagePtrs) const
+{
+  if (firstPage < 1 || count < 0)
+    return BADPAGENO;
+
+  vector<PageIO> pages(count);
+  for (int i = 0; i < count; i++) {
+    if (!pagePtrs[i])
+      return BADPAGEPTR;
+    pages[i].pageNo = firstPage + i;
+    pages[i].page = pagePtrs[i];
+  }
+  return count ? transferPages(unixFile, false, &pages[0], count, direct) : OK;
+}
+
+
+// Write count consecutive pages starting at firstPage from the pages
+// pointed to by pagePtrs, like readPages.
+
+const Status File::writePages(const pageno_t firstPage, const int count,
+			      const Page* const* pagePtrs)
+{
+  if (firstPage < 1 || count < 0)
+    return BADPAGENO;
+
+  vector<PageIO> pages(count);
+  for (int i = 0; i < count; i++) {
+    if (!pagePtrs[i])
+      return BADPAGEPTR;
+    pages[i].pageNo = firstPage + i;
+    pages[i].page = (Page*)pagePtrs[i];
+  }
+  return count ? transferPages(unixFile, true, &pages[0], count, direct) : OK;
+}
+
+
+// Check count (pageNo, page) pairs handed to readPages or writePages.
+
+static const Status checkPages(const PageIO* pages, const int count)
+{
+  for (int i = 0; i < count; i++) {
+    if (pages[i].pageNo < 1)
+      return BADPAGENO;
+    if (!pages[i].page)
+      return BADPAGEPTR;
+  }
+  return OK;
+}
+
+
+// Read count (pageNo, page) pairs, each page into its own buffer.
+
+const Status File::readPages(const PageIO* pages, const int count) const
+{
+  Status status = checkPages(pages, count);
+  if (status != OK)
+    return status;
+  return transferPages(unixFile, false, pages, count, direct);
+}
+
+
+// Write count (pageNo, page) pairs, each buffer to its own page.
+
+const Status File::writePages(const PageIO* pages, const int count)
+{
+  Status status = checkPages(pages, count);
+  if (status != OK)
+    return status;
+  return transferPages(unixFile, true, pages, count, direct);
+}
+
+
 // Write a page to file, check parameters for validity.
 
-const Status File::writePage(const int pageNo, const Page *pagePtr)
+const Status File::writePage(const pageno_t pageNo, const Page *pagePtr)
 {
   if (!pagePtr)
     return BADPAGEPTR;
@@ -409,17 +1228,14 @@ const Status File::writePage(const int pageNo, const Page *pagePtr)
 
 
 // Return the number of the first page in file. It is stored
-// on the file's header page (field firstPage).
+// on the file's header page (field firstPage), which is cached.
 
-const Status File::getFirstPage(int& pageNo) const
+const Status File::getFirstPage(pageno_t& pageNo) const
 {
-  Page header;
-  Status status;
-
-  if ((status = intread(0, &header)) != OK)
-    return status;
-
-  pageNo = DBP(header).firstPage;
+  pthread_mutex_lock(&hdrLatch);
+  pageNo = header.firstPage;
+  headerIOSaved++;
+  pthread_mutex_unlock(&hdrLatch);
 
   return OK;
 }
@@ -427,21 +1243,17 @@ const Status File::getFirstPage(int& pageNo) const
 
 #ifdef DEBUGFREE
 
-// Print out the page numbers on the free list. For debugging only.
+// Print out the first free page numbers. For debugging only.
 
 void File::listFree()
 {
   cerr << "%%  File " << (int)this << " free pages:";
-  int pageNo = 0;
-  for(int i = 0; i < 10; i++) {
-    Page page;
-    if (intread(pageNo, &page) != OK)
-      break;
-    pageNo = DBP(page).nextFree;
-    cerr << " " << pageNo;
-    if (pageNo == -1)
-      break;
-  }
+  int shown = 0;
+  for(pageno_t pageNo = 1; pageNo < header.numPages && shown < 10; pageNo++)
+    if (isFree(pageNo)) {
+      cerr << " " << pageNo;
+      shown++;
+    }
   cerr << endl;
 }
 #endif
@@ -506,9 +1318,13 @@ const Status DB::destroyFile(const string & fileName)
 
 // Open a database file. If file already open, increment open count,
 // otherwise find a vacant slot in the open files table and store
-// file info there.
+// file info there. If mode has MAPPED, the file is also mapped so that
+// BufMgr reads its pages in place rather than into the buffer pool; if
+// it has DIRECT, pages are transferred with O_DIRECT, bypassing the
+// kernel's page cache.
 
-const Status DB::openFile(const string & fileName, File*& filePtr)
+const Status DB::openFile(const string & fileName, File*& filePtr,
+			  const int mode)
 {
   Status status;
   File* file;
@@ -520,7 +1336,7 @@ const Status DB::openFile(const string & fileName, File*& filePtr)
   {
       // file is already open, call open again on the file object
       // to increment it's open count.
-      status = file->open();
+      status = file->open(mode);
       filePtr = file;
   }
   else
@@ -528,7 +1344,7 @@ const Status DB::openFile(const string & fileName, File*& filePtr)
       // file is not already open
       // Otherwise create a new file object and open it
       filePtr = new File(fileName);
-      status = filePtr->open();
+      status = filePtr->open(mode);
 
       if (status != OK)
 	{
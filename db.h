@@ -2,7 +2,9 @@
 #define DB_H
 
 #include <sys/types.h>
+#include <pthread.h>
 #include <functional>
+#include <vector>
 #include "error.h"
 #include <string.h>
 using namespace std;
@@ -15,6 +17,70 @@ using namespace std;
 // forward class definition for db
 class DB;
 
+// page number within a file; 64 bits, so files are not limited to 2^31
+// pages
+typedef long long pageno_t;
+
+// Free pages are tracked by a free-space map: one bit per page, set
+// when the page is free.  The map is split over map pages of MAPBITS
+// bits each, map page k covering pages k*MAPBITS..(k+1)*MAPBITS-1.  A
+// map page is only created once a page in its range is disposed of,
+// so files that never free a page have none.  A map page always lies
+// in the range it covers.
+//
+// The header lists the first MAXMAPPAGES map pages.  Once a file needs
+// a map page beyond those, the last header entry instead starts a chain
+// of directory pages, each listing the numbers of DIRENTRIES further
+// map pages and ending with the number of the next directory page, 0
+// for the last.  Like map pages, directory pages are taken from pages
+// being disposed of, and there is no limit on their number.
+
+const int MAPBITS = PAGESIZE * 8;          // pages covered by one map page
+const int MAXMAPPAGES = (PAGESIZE - 6 * sizeof(int) - 4 * sizeof(pageno_t))
+                        / sizeof(pageno_t);
+const int DIRENTRIES = PAGESIZE / sizeof(pageno_t) - 1; // map pages per directory page
+
+// Files opened DIRECT bypass the kernel page cache (O_DIRECT).  The
+// kernel then wants each transfer aligned to the device block size, in
+// memory and in the file.  DIRECT is refused unless PAGESIZE is a
+// multiple of DIRECTALIGN, so that every frame of the buffer pool is on
+// a DIRECTALIGN boundary; pages anywhere else go through an aligned
+// bounce buffer.
+
+const int DIRECTALIGN = 4096;              // buffer alignment for O_DIRECT
+
+// how DB::openFile opens a file; MAPPED and DIRECT may be or-ed together
+enum OpenMode { BUFFERED = 0, MAPPED = 1, DIRECT = 2 };
+
+// structure of DB (header) page.  Files predating 64-bit page numbers
+// kept them in the int fields up front; those are 0 in current files,
+// and a file whose oldNumPages is not is upgraded when opened.
+
+typedef struct {
+  int nextFree;                         // page # of next page on free list,
+                                        // only in files predating the map
+  int oldFirstPage;                     // 32-bit firstPage of older files
+  int oldNumPages;                      // 32-bit numPages of older files
+  int oldNumFree;                       // 32-bit numFree of older files
+  int numMaps;                          // # of map page ranges, more than
+                                        // MAXMAPPAGES if there is a directory
+  int pageSize;                         // PAGESIZE the file was created with
+  pageno_t firstPage;                   // page # of first page in file
+  pageno_t numPages;                    // total # of pages in file
+  pageno_t numFree;                     // # of free pages
+  pageno_t mapPages[MAXMAPPAGES];       // page # of each map page, 0 if none;
+                                        // the last is the first directory page
+                                        // if there is a directory
+} DBPage;
+
+// one page of a scattered read or write: the page number in the file
+// and where the page is in memory
+struct PageIO
+{
+  pageno_t pageNo;
+  Page*	   page;
+};
+
 // class definition for open files
 class File {
   friend class DB;
@@ -22,13 +88,30 @@ class File {
 
  public:
 
-  Status allocatePage(int& pageNo);     // allocate a new page
-  const Status disposePage(const int pageNo);       // release space for a page
-  const Status readPage(const int pageNo,
+  Status allocatePage(pageno_t& pageNo); // allocate a new page
+  const Status allocatePages(const int n,
+		   pageno_t& firstPageNo);    // extend file by n zeroed pages
+  const Status disposePage(const pageno_t pageNo);  // release space for a page
+  const Status compact();               // truncate the free pages the file ends with
+  const Status readPage(const pageno_t pageNo,
 		  Page* pagePtr) const;       // read page from file
-  const Status writePage(const int pageNo,
+  const Status writePage(const pageno_t pageNo,
 		   const Page* pagePtr);      // write page to file
-  const Status getFirstPage(int& pageNo) const;     // returns pageNo of first page
+  const Status readPages(const pageno_t firstPage, const int count,
+		   Page** pagePtrs) const;    // read a run of pages with one preadv
+  const Status writePages(const pageno_t firstPage, const int count,
+		   const Page* const* pagePtrs); // write a run of pages with one pwritev
+  const Status readPages(const PageIO* pages,
+		   const int count) const;    // read any pages, one preadv per adjacent run
+  const Status writePages(const PageIO* pages,
+		   const int count);          // write any pages, one pwritev per adjacent run
+  const Status getFirstPage(pageno_t& pageNo) const; // returns pageNo of first page
+  Page* mappedPage(const pageno_t pageNo) const; // page in the read-only mapping, or NULL
+  void willNeed(const pageno_t firstPage,
+		const int count) const;       // hint that mapped pages will be read
+  const Status syncHeader();            // write the cached header page if changed
+  void setHeaderSync(const int updates); // also write it every updates changes, 0 = never
+  long getHeaderIOSaved() const;        // header reads and writes avoided since open
 
   bool operator == (const File & other) const
     {
@@ -43,12 +126,27 @@ class File {
   static const Status create(const string &fileName);
   static const Status destroy(const string &fileName);
 
-  const Status open();
+  const Status open(const int mode);
   const Status close();
-
-  const Status intread(const int pageNo,
+  const Status map();                   // map the file read-only
+
+  const Status intallocate(pageno_t& pageNo);       // allocatePage, hdrLatch held
+  const Status intdispose(const pageno_t pageNo);   // disposePage, hdrLatch held
+  const Status headerChanged();                     // note an update, hdrLatch held
+  const Status writeHeader();                       // syncHeader, hdrLatch held
+  const Status loadHeader(const Page& hdrPage);     // take the header read at open
+  const Status loadFreeMap();                       // read the map pages, open only
+  bool isFree(const pageno_t pageNo) const;         // test a bit of the free-space map
+  void setFree(const pageno_t pageNo, const bool free); // set a bit of the free-space map
+  const Status markFree(const pageno_t pageNo);     // add a page to the free-space map
+  bool isMapPage(const pageno_t pageNo) const;      // a map or directory page?
+  size_t dirPagesNeeded() const;                    // directory pages mapPages takes
+  const Status punch(const pageno_t pageNo);        // give a free page's blocks back
+  pageno_t findFree(const int n) const;             // lowest run of n free, unmapped pages, or -1
+
+  const Status intread(const pageno_t pageNo,
 		 Page* pagePtr) const;        // internal file read
-  const Status intwrite(const int pageNo,
+  const Status intwrite(const pageno_t pageNo,
 		  const Page* pagePtr);       // internal file write
 
 #ifdef DEBUGFREE
@@ -58,6 +156,24 @@ class File {
   string fileName;                    // The name of the file
   int openCnt;                        // # times file has been opened
   int unixFile;                       // unix file stream for file
+  int holePages;                      // pages per file system block, 0 if
+                                      // holes cannot be punched
+  bool direct;                        // opened with O_DIRECT
+  char* mapping;                      // read-only mapping of the file, or NULL
+  pageno_t mappedPages;               // pages 0..mappedPages-1 are mapped
+  size_t mapLength;                   // bytes mapped at mapping
+  mutable pthread_mutex_t hdrLatch;   // protects the cached header page
+  DBPage header;                      // header page, cached while file is open
+  bool headerDirty;                   // header changed since last written
+  int headerSync;                     // write header after this many changes
+  int headerUpdates;                  // changes since header last written
+  vector<unsigned char> freeMap;      // the free-space map, bit p for page p
+  vector<bool> mapDirty;              // map pages changed since last written
+  vector<pageno_t> mapPages;          // map page of each range, 0 if none
+  vector<pageno_t> mapDir;            // directory pages, in chain order
+  bool mapDirDirty;                   // directory changed since last written
+  size_t freeHint;                    // no free page below this byte of freeMap
+  mutable long headerIOSaved;         // header reads and writes avoided
 };
 
 class BufMgr;
@@ -106,20 +222,12 @@ class DB {
   const Status createFile(const string & fileName) ;  // create a new file
   const Status destroyFile(const string & fileName) ; // destroy a file, 
                                                            // release all space
-  const Status openFile(const string & fileName, File* & file);  // open a file
+  const Status openFile(const string & fileName, File* & file,
+		  const int mode = BUFFERED);  // open a file, see OpenMode
   const Status closeFile(File* file);         // close a file
 
  private:
   OpenFileHashTbl   openFiles;    // list of open files
 };
 
-
-// structure of DB (header) page
-
-typedef struct {
-  int nextFree;                         // page # of next page on free list
-  int firstPage;                        // page # of first page in file
-  int numPages;                         // total # of pages in file
-} DBPage;
-
 #endif
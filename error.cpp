@@ -24,6 +24,7 @@ void Error::print(Status status)
     case BADPAGEPTR:   cerr << "bad page pointer"; break;
     case BADPAGENO:    cerr << "bad page number"; break;
     case FILEEXISTS:   cerr << "file exists already"; break;
+    case BADPAGESIZE:  cerr << "page size does not suit the file or mode"; break;
 
     // BufMgr and HashTable errors
 
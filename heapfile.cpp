@@ -0,0 +1,469 @@
+#include <limits.h>
+#include "heapfile.h"
+#include "error.h"
+
+
+// The category in the space map of a page with freeBytes free.
+
+static int spaceCategory(const int freeBytes)
+{
+  int category = freeBytes * SPACELEVELS / (int)PAGESIZE;
+  return category < SPACELEVELS ? category : SPACELEVELS - 1;
+}
+
+
+// Create a heap file: allocate its header page and a first, empty data
+// page, and point the header at it.
+
+const Status createHeapFile(const string & fileName)
+{
+  Status status;
+  File* file;
+  pageno_t hdrPageNo, dataPageNo;
+  Page* hdrPage;
+  Page* dataPage;
+
+  if ((status = db.createFile(fileName)) != OK) return status;
+  if ((status = db.openFile(fileName, file)) != OK) return status;
+
+  if ((status = bufMgr->allocPage(file, hdrPageNo, hdrPage)) != OK) {
+    db.closeFile(file);
+    return status;
+  }
+  if ((status = bufMgr->allocPage(file, dataPageNo, dataPage)) != OK) {
+    bufMgr->unPinPage(file, hdrPageNo, false);
+    db.closeFile(file);
+    return status;
+  }
+  dataPage->init(dataPageNo);
+
+  FileHdrPage* hdr = (FileHdrPage*)hdrPage;
+  hdr->firstPage = dataPageNo;
+  hdr->lastPage = dataPageNo;
+  hdr->pageCnt = 1;
+  hdr->recCnt = 0;
+
+  bufMgr->unPinPage(file, dataPageNo, true);
+  bufMgr->unPinPage(file, hdrPageNo, true);
+  if ((status = bufMgr->flushFile(file)) != OK) {
+    db.closeFile(file);
+    return status;
+  }
+  return db.closeFile(file);
+}
+
+const Status destroyHeapFile(const string & fileName)
+{
+  return db.destroyFile(fileName);
+}
+
+
+// Open a heap file and pin its header page.  The header page is the
+// first page of the underlying file.
+
+HeapFile::HeapFile(const string & fileName, Status& returnStatus)
+{
+  Status status;
+  Page* pagePtr;
+
+  headerPage = NULL;
+  hdrDirtyFlag = false;
+  curPage = NULL;
+  curPageNo = -1;
+  curDirtyFlag = false;
+  curVersion = 0;
+  for (int c = 0; c < SPACELEVELS; c++)
+    spaceHint[c] = 0;
+
+  if ((status = db.openFile(fileName, filePtr)) != OK) {
+    filePtr = NULL;
+    returnStatus = status;
+    return;
+  }
+  if ((status = filePtr->getFirstPage(headerPageNo)) != OK ||
+      (status = bufMgr->readPage(filePtr, headerPageNo, pagePtr)) != OK) {
+    db.closeFile(filePtr);
+    filePtr = NULL;
+    returnStatus = status;
+    return;
+  }
+  headerPage = (FileHdrPage*)pagePtr;
+  returnStatus = OK;
+}
+
+// Unpin the header and current pages and close the file.
+
+HeapFile::~HeapFile()
+{
+  if (!filePtr) return;
+  if (curPage) bufMgr->unPinPage(filePtr, curPageNo, curDirtyFlag);
+  bufMgr->unPinPage(filePtr, headerPageNo, hdrDirtyFlag);
+  db.closeFile(filePtr);
+}
+
+const int HeapFile::getRecCnt() const
+{
+  return headerPage->recCnt;
+}
+
+// Make pageNo the current page.  Nothing is done if it already is;
+// otherwise the page before is unpinned first.
+
+const Status HeapFile::setCurPage(const pageno_t pageNo)
+{
+  Status status;
+
+  if (curPage && curPageNo == pageNo) return OK;
+  if (curPage) {
+    status = bufMgr->unPinPage(filePtr, curPageNo, curDirtyFlag);
+    curPage = NULL;
+    curPageNo = -1;
+    curDirtyFlag = false;
+    curVersion++;
+    if (status != OK) return status;
+  }
+  if ((status = bufMgr->readPage(filePtr, pageNo, curPage)) != OK) {
+    curPage = NULL;
+    return status;
+  }
+  curPageNo = pageNo;
+  curVersion++;
+  return OK;
+}
+
+// A RID may only name a data page: the header and the map pages hold no
+// records, and a record call on one would take its bytes for slots.
+
+const bool HeapFile::isDataPage(const pageno_t pageNo) const
+{
+  if (pageNo < 1 || pageNo == headerPageNo) return false;
+  for (int k = 0; k < headerPage->numMaps; k++)
+    if (headerPage->mapPages[k] == pageNo) return false;
+  return true;
+}
+
+// Return the record with RID rid.  The record is not copied: rec points
+// into the current page and is good until the next call.
+
+const Status HeapFile::getRecord(const RID & rid, Record & rec)
+{
+  Status status;
+
+  if (!isDataPage(rid.pageNo)) return BADRID;
+  if ((status = setCurPage(rid.pageNo)) != OK) return status;
+  return curPage->getRecord(rid, rec);
+}
+
+// Insert a record on the current page if it has room, else on a page
+// the space map finds for it, else on the last page or on a new page
+// linked in after it.
+
+const Status HeapFile::insertRecord(const Record & rec, RID& outRid)
+{
+  Status status;
+  pageno_t pageNo;
+  Page* newPage;
+  const int needed = rec.length + sizeof(slot_t);
+
+  // a record that does not fit on an empty page would never fit
+  if (rec.length < 0 || needed > (int)(PAGESIZE - DPFIXED)) return INVALIDRECLEN;
+
+  if (!curPage || curPage->getFreeSpace() < needed) {
+    if (findSpace(needed, pageNo) != OK) pageNo = headerPage->lastPage;
+    if ((status = setCurPage(pageNo)) != OK) return status;
+  }
+  int before = curPage->getFreeSpace();
+  status = curPage->insertRecord(rec, outRid);
+  if (status == NOSPACE && curPageNo != headerPage->lastPage) {
+    // the space map was out of date
+    if ((status = setSpace(curPageNo, before)) != OK) return status;
+    if ((status = setCurPage(headerPage->lastPage)) != OK) return status;
+    before = curPage->getFreeSpace();
+    status = curPage->insertRecord(rec, outRid);
+  }
+  if (status == NOSPACE) {
+    if ((status = bufMgr->allocPage(filePtr, pageNo, newPage)) != OK)
+      return status;
+    if (pageNo > INT_MAX) {
+      bufMgr->unPinPage(filePtr, pageNo, false);
+      bufMgr->disposePage(filePtr, pageNo);
+      return BADPAGENO;
+    }
+    newPage->init(pageNo);
+    curPage->setNextPage(pageNo);
+    headerPage->lastPage = pageNo;
+    headerPage->pageCnt++;
+    hdrDirtyFlag = true;
+
+    // the new page, still pinned, becomes the current one
+    status = bufMgr->unPinPage(filePtr, curPageNo, true);
+    curPage = newPage;
+    curPageNo = pageNo;
+    curDirtyFlag = true;
+    curVersion++;
+    if (status != OK) return status;
+    before = 0; // not in the space map yet
+    status = curPage->insertRecord(rec, outRid);
+  }
+  if (status != OK) return status;
+
+  curDirtyFlag = true;
+  curVersion++;
+  headerPage->recCnt++;
+  hdrDirtyFlag = true;
+  if (spaceCategory(before) != spaceCategory(curPage->getFreeSpace()))
+    return setSpace(curPageNo, curPage->getFreeSpace());
+  return OK;
+}
+
+// Delete the record with RID rid.  The page stays on the chain even if
+// it is left empty.
+
+const Status HeapFile::deleteRecord(const RID & rid)
+{
+  Status status;
+
+  if (!isDataPage(rid.pageNo)) return BADRID;
+  if ((status = setCurPage(rid.pageNo)) != OK) return status;
+  int before = curPage->getFreeSpace();
+  if ((status = curPage->deleteRecord(rid)) != OK) return status;
+
+  curDirtyFlag = true;
+  curVersion++;
+  headerPage->recCnt--;
+  hdrDirtyFlag = true;
+  if (spaceCategory(before) != spaceCategory(curPage->getFreeSpace()))
+    return setSpace(curPageNo, curPage->getFreeSpace());
+  return OK;
+}
+
+// Enter the category of page pageNo in its map page, creating the map
+// page if it is not there yet.  mapMax is raised along with it, but only
+// lowered by findSpace when it finds it too high.
+
+const Status HeapFile::setSpace(const pageno_t pageNo, const int freeBytes)
+{
+  Status status;
+  pageno_t mapPageNo;
+  Page* mapPage;
+  const int k = pageNo / SPACEMAPPAGES;
+  const int entry = pageNo % SPACEMAPPAGES;
+  const int category = spaceCategory(freeBytes);
+
+  if (k >= MAXSPACEMAPS) return OK; // beyond what the map tracks
+
+  if (headerPage->mapPages[k] == 0) {
+    // pages not in any map page are in category 0 already
+    if (category == 0) return OK;
+    if ((status = bufMgr->allocPage(filePtr, mapPageNo, mapPage)) != OK)
+      return status;
+    if (mapPageNo > INT_MAX) {
+      bufMgr->unPinPage(filePtr, mapPageNo, false);
+      return bufMgr->disposePage(filePtr, mapPageNo);
+    }
+    headerPage->mapPages[k] = mapPageNo;
+    headerPage->mapMax[k] = 0;
+    if (k >= headerPage->numMaps) headerPage->numMaps = k + 1;
+    hdrDirtyFlag = true;
+  }
+  else {
+    mapPageNo = headerPage->mapPages[k];
+    if ((status = bufMgr->readPage(filePtr, mapPageNo, mapPage)) != OK)
+      return status;
+  }
+
+  unsigned char& bits = ((unsigned char*)mapPage)[entry / (8 / SPACEBITS)];
+  const int shift = entry % (8 / SPACEBITS) * SPACEBITS;
+  const bool changed = ((bits >> shift) & (SPACELEVELS - 1)) != category;
+  if (changed)
+    bits = (bits & ~((SPACELEVELS - 1) << shift)) | (category << shift);
+  if (category > headerPage->mapMax[k]) {
+    headerPage->mapMax[k] = category;
+    hdrDirtyFlag = true;
+  }
+  for (int c = 1; c <= category; c++)
+    if (pageNo < spaceHint[c]) spaceHint[c] = pageNo;
+  return bufMgr->unPinPage(filePtr, mapPageNo, changed);
+}
+
+// Find the first page whose category guarantees needed bytes free.  The
+// search starts at the hint for the category, and map pages whose
+// mapMax is too low are passed over without reading them, so it reads
+// at most the one map page it finds a page in, plus any whose mapMax it
+// finds too high and corrects.
+
+const Status HeapFile::findSpace(const int needed, pageno_t& pageNo)
+{
+  Status status;
+  Page* mapPage;
+  const int category = (needed * SPACELEVELS + PAGESIZE - 1) / PAGESIZE;
+
+  if (category >= SPACELEVELS) return NOSPACE;
+  for (int k = spaceHint[category] / SPACEMAPPAGES; k < headerPage->numMaps; k++) {
+    if (headerPage->mapPages[k] == 0 || headerPage->mapMax[k] < category)
+      continue;
+    if ((status = bufMgr->readPage(filePtr, headerPage->mapPages[k], mapPage)) != OK)
+      return status;
+
+    // entries before the hint are all below category
+    const unsigned char* bits = (const unsigned char*)mapPage;
+    int start = 0;
+    if (k == spaceHint[category] / SPACEMAPPAGES)
+      start = spaceHint[category] % SPACEMAPPAGES & ~(8 / SPACEBITS - 1);
+    int highest = start > 0 ? category - 1 : 0, found = -1;
+    for (int entry = start; entry < SPACEMAPPAGES && found < 0; entry++) {
+      if (entry % (8 / SPACEBITS) == 0 && bits[entry / (8 / SPACEBITS)] == 0) {
+	entry += 8 / SPACEBITS - 1; // a byte of full pages
+	continue;
+      }
+      int c = (bits[entry / (8 / SPACEBITS)] >> (entry % (8 / SPACEBITS) * SPACEBITS))
+	      & (SPACELEVELS - 1);
+      if (c >= category) found = entry;
+      else if (c > highest) highest = c;
+    }
+    if ((status = bufMgr->unPinPage(filePtr, headerPage->mapPages[k], false)) != OK)
+      return status;
+    if (found >= 0) {
+      pageNo = (pageno_t)k * SPACEMAPPAGES + found;
+      spaceHint[category] = pageNo;
+      return OK;
+    }
+    headerPage->mapMax[k] = highest;
+    hdrDirtyFlag = true;
+  }
+  // the hint is this instance's alone, and another one open on the file
+  // may free space behind it; start over next time, which mapMax keeps
+  // from reading map pages with nothing big enough
+  spaceHint[category] = 0;
+  return NOSPACE;
+}
+
+
+HeapFileScan::HeapFileScan(const string & fileName, Status& returnStatus,
+			   const int readAhead)
+  : HeapFile(fileName, returnStatus)
+{
+  window = readAhead;
+  fetchedTo = 0;
+  inOrder = 0;
+  scanning = false;
+  scanPageNo = -1;
+  nextSlot = fetchSlot = 0;
+  batchCnt = batchPos = 0;
+  batchVersion = -1;
+}
+
+HeapFileScan::~HeapFileScan()
+{
+  endScan();
+}
+
+// Position the scan before the first record of the first data page.
+
+const Status HeapFileScan::startScan()
+{
+  Status status;
+  int nextPageNo;
+
+  if (!headerPage) return BADSCANID;
+  scanPageNo = headerPage->firstPage;
+  if ((status = setCurPage(scanPageNo)) != OK) return status;
+  scanning = true;
+  nextSlot = fetchSlot = 0;
+  batchCnt = batchPos = 0;
+  batchVersion = curVersion;
+
+  fetchedTo = 0;
+  inOrder = 0;
+  curPage->getNextPage(nextPageNo);
+  readAheadFrom(nextPageNo);
+  return OK;
+}
+
+// Return the next record of the scan.  Records are taken from the page
+// a batch at a time, and the next page along the chain is only pinned
+// once the batch runs out and the page has no more.
+
+const Status HeapFileScan::scanNext(RID& outRid, Record& rec)
+{
+  Status status;
+  int nextPageNo;
+
+  if (!scanning) return BADSCANID;
+
+  // an insert or delete since the batch was taken may have moved the
+  // records or left the page; take the rest of them again
+  if (batchVersion != curVersion) {
+    if ((status = setCurPage(scanPageNo)) != OK) return status;
+    batchCnt = batchPos = 0;
+    fetchSlot = nextSlot;
+    batchVersion = curVersion;
+  }
+
+  while (batchPos == batchCnt) {
+    batchPos = 0;
+    if (curPage->getRecords(fetchSlot, batch, BATCH, batchCnt) == OK) break;
+    curPage->getNextPage(nextPageNo);
+    if (nextPageNo == -1) return FILEEOF;
+
+    if ((status = setCurPage(nextPageNo)) != OK) return status;
+    scanPageNo = nextPageNo;
+    nextSlot = fetchSlot = 0;
+    batchVersion = curVersion;
+    curPage->getNextPage(nextPageNo);
+    readAheadFrom(nextPageNo);
+  }
+
+  const PageRecord& next = batch[batchPos++];
+  nextSlot = next.rid.slotNo + 1;
+  outRid = next.rid;
+  rec.data = next.data;
+  rec.length = next.length;
+  return OK;
+}
+
+// End the scan and unpin its page.
+
+const Status HeapFileScan::endScan()
+{
+  Status status = OK;
+
+  if (!scanning) return OK;
+  scanning = false;
+  if (curPage) {
+    status = bufMgr->unPinPage(filePtr, curPageNo, curDirtyFlag);
+    curPage = NULL;
+    curPageNo = -1;
+    curDirtyFlag = false;
+    curVersion++;
+  }
+  return status;
+}
+
+// Queue pages for reading ahead of the scan, which has just moved to
+// curPageNo.  Only nextPageNo is known to be on the chain; the pages
+// after it are guessed by number, which holds while the chain runs
+// through consecutive pages, as it does where pages were appended in
+// the order they were allocated.  So the guess is only made while the
+// chain has been in page order, over as many pages as it has gone on
+// being so, up to window, and the window is topped up each time the
+// scan is half way through it.  Once the chain jumps (to a reused free
+// page, say, or past pages another file took meanwhile), only the page
+// it lands on is read ahead, until it runs in order again.
+
+void HeapFileScan::readAheadFrom(const pageno_t nextPageNo)
+{
+  if (window <= 0 || nextPageNo < 1) return;
+  if (nextPageNo != curPageNo + 1) {
+    inOrder = 0;
+    bufMgr->prefetch(filePtr, nextPageNo, 1);
+    fetchedTo = nextPageNo + 1;
+    return;
+  }
+  if (inOrder < window) inOrder++;
+  if (nextPageNo > fetchedTo) fetchedTo = nextPageNo;
+  if (fetchedTo - nextPageNo <= inOrder / 2) {
+    bufMgr->prefetch(filePtr, fetchedTo, nextPageNo + inOrder - fetchedTo);
+    fetchedTo = nextPageNo + inOrder;
+  }
+}
@@ -0,0 +1,148 @@
+#ifndef HEAPFILE_H
+#define HEAPFILE_H
+
+#include <sys/types.h>
+#include <functional>
+#include <string>
+using namespace std;
+
+#include "page.h"
+#include "buf.h"
+
+extern DB db;
+
+// A heap file is an unordered set of records kept on a chain of data
+// pages linked through their nextPage fields.  The first page of the
+// file is a header page, holding a FileHdrPage, that tells where the
+// chain starts and ends.  Page links and RIDs are ints, so a heap file
+// cannot grow past page 2^31-1.
+//
+// The free space of the data pages is kept in a space map of SPACEBITS
+// bits per page, so that an insert can find a page with room without
+// reading any.  Page p of the file has category c in the map if it has
+// at least c/SPACELEVELS of a page free; the other pages of the file are
+// in category 0.  The map is split over map pages of SPACEMAPPAGES
+// entries, created as they are needed and read through the buffer pool.
+// Pages beyond the range of the last map page the header can hold are
+// not tracked, and only ever filled while they are the last page.
+
+const int SPACEBITS = 4;                         // bits per page in the map
+const int SPACELEVELS = 1 << SPACEBITS;          // categories of free space
+const int SPACEMAPPAGES = PAGESIZE * 8 / SPACEBITS; // pages per map page
+const int MAXSPACEMAPS = (PAGESIZE - 5 * sizeof(int))
+                         / (sizeof(int) + sizeof(unsigned char));
+
+struct FileHdrPage
+{
+  int firstPage;	// page # of the first data page
+  int lastPage;		// page # of the last data page
+  int pageCnt;		// number of data pages
+  int recCnt;		// number of records in the file
+  int numMaps;		// # of entries of mapPages in use
+  int mapPages[MAXSPACEMAPS];	// page # of each map page, 0 if none
+  unsigned char mapMax[MAXSPACEMAPS]; // no page in map page k is in a
+				      // higher category than mapMax[k]
+};
+
+// create an empty heap file: a header page and one data page
+const Status createHeapFile(const string & fileName);
+
+// destroy a heap file, which must not be open
+const Status destroyHeapFile(const string & fileName);
+
+
+// An open heap file.  The header page stays pinned while the file is
+// open, and so does the data page last used, so that runs of calls on
+// the same page pin it only once.  Records handed out point into that
+// page and are only valid until the next call.
+
+class HeapFile {
+protected:
+  File*		filePtr;	// underlying DB file
+  FileHdrPage*	headerPage;	// pinned header page
+  pageno_t	headerPageNo;	// page # of header page
+  bool		hdrDirtyFlag;	// header page changed since pinned
+
+  Page*		curPage;	// pinned data page, or NULL
+  pageno_t	curPageNo;	// page # of curPage
+  bool		curDirtyFlag;	// curPage changed since pinned
+  int		curVersion;	// bumped when curPage is switched or updated
+  pageno_t	spaceHint[SPACELEVELS]; // as far as this instance knows, no
+					// page below spaceHint[c] is in
+					// category c or above
+
+  // makes pageNo the current page, unpinning the one before
+  const Status setCurPage(const pageno_t pageNo);
+
+  // records in the space map that page pageNo has freeBytes free
+  const Status setSpace(const pageno_t pageNo, const int freeBytes);
+
+  // finds a page the space map says has at least needed bytes free,
+  // returns NOSPACE if there is none
+  const Status findSpace(const int needed, pageno_t& pageNo);
+
+  // true if pageNo can hold records: not the header or a map page
+  const bool isDataPage(const pageno_t pageNo) const;
+
+public:
+  // opens the heap file; returnStatus is set to OK if it could be
+  HeapFile(const string & fileName, Status& returnStatus);
+  ~HeapFile();
+
+  // number of records in the file
+  const int getRecCnt() const;
+
+  // returns the record with RID rid, pointing into the pinned page
+  const Status getRecord(const RID & rid, Record & rec);
+
+  // adds a record on a page with room for it, returning its RID
+  const Status insertRecord(const Record & rec, RID& outRid);
+
+  // deletes the record with RID rid
+  const Status deleteRecord(const RID & rid);
+};
+
+
+// A sequential scan of a heap file.  Each data page along the chain is
+// pinned once, while its records are handed out in batches taken with
+// Page::getRecords; scanNext gives the caller a pointer into the page
+// rather than a copy.  While the scan is on one page the next ones are
+// read ahead by the buffer manager's prefetch thread.  Records may be
+// inserted and deleted through the scan while it runs.
+
+class HeapFileScan : public HeapFile {
+public:
+  // readAhead is the number of pages to have read ahead, 0 for none
+  HeapFileScan(const string & fileName, Status& returnStatus,
+	       const int readAhead = 8);
+  ~HeapFileScan();
+
+  // starts the scan at the first data page
+  const Status startScan();
+
+  // returns the next record and its RID, FILEEOF after the last one
+  const Status scanNext(RID& outRid, Record& rec);
+
+  // stops the scan, unpinning its page
+  const Status endScan();
+
+private:
+  static const int BATCH = 64;	// records taken from a page at a time
+
+  // queues pages after the current one for reading ahead
+  void readAheadFrom(const pageno_t nextPageNo);
+
+  int		window;		// pages to keep read ahead
+  pageno_t	fetchedTo;	// pages below this have been queued
+  int		inOrder;	// links in page order the chain has run through
+  bool		scanning;	// between startScan and endScan
+  pageno_t	scanPageNo;	// page # of the page being scanned
+  int		nextSlot;	// slot # after the record last handed out
+  int		fetchSlot;	// where getRecords continues on the page
+  PageRecord	batch[BATCH];	// records taken from the page
+  int		batchCnt;	// records in batch
+  int		batchPos;	// next record of batch to hand out
+  int		batchVersion;	// curVersion when batch was taken
+};
+
+#endif
@@ -0,0 +1,380 @@
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#ifdef __linux__
+#include <linux/io_uring.h>
+#endif
+#include "io.h"
+
+// disk I/O backend implementations
+
+
+static SyncBackend syncBackend;
+IOBackend* IOBackend::current = &syncBackend;
+
+
+//-------------------------------------------------------------------
+// IOBatch
+//-------------------------------------------------------------------
+
+IOBatch::IOBatch() : pending(0), failed(false)
+{
+  pthread_mutex_init(&lock, NULL);
+  pthread_cond_init(&done, NULL);
+}
+
+IOBatch::~IOBatch()
+{
+  pthread_cond_destroy(&done);
+  pthread_mutex_destroy(&lock);
+}
+
+const Status IOBatch::wait()
+{
+  pthread_mutex_lock(&lock);
+  while (pending > 0)
+    pthread_cond_wait(&done, &lock);
+  bool ok = !failed;
+  failed = false;
+  pthread_mutex_unlock(&lock);
+  return ok ? OK : UNIXERR;
+}
+
+void IOBatch::complete(const IORequest& request, const ssize_t result)
+{
+  pthread_mutex_lock(&lock);
+  if (result != (ssize_t)request.length)
+    failed = true;
+  if (--pending == 0)
+    pthread_cond_broadcast(&done);
+  pthread_mutex_unlock(&lock);
+}
+
+
+//-------------------------------------------------------------------
+// IOBackend
+//-------------------------------------------------------------------
+
+const Status IOBackend::select(const IOKind kind, const int depth)
+{
+  IOBackend* backend;
+  switch (kind) {
+    case THREADIO:
+      backend = new ThreadBackend(depth > 0 ? depth : 1);
+      break;
+    case URINGIO: {
+      UringBackend* uring = new UringBackend(depth > 0 ? depth : 1);
+      if (uring->setup() != OK) {
+	delete uring;
+	return UNIXERR;
+      }
+      backend = uring;
+      break;
+    }
+    case SYNCIO:
+    default:
+      backend = &syncBackend;
+      break;
+  }
+  if (current != &syncBackend)
+    delete current;
+  current = backend;
+  return OK;
+}
+
+// counts the requests against the batch before any of them can complete
+void IOBackend::enlist(IORequest* requests, const int n, IOBatch& batch)
+{
+  pthread_mutex_lock(&batch.lock);
+  batch.pending += n;
+  pthread_mutex_unlock(&batch.lock);
+  for (int i = 0; i < n; i++)
+    requests[i].batch = &batch;
+}
+
+void IOBackend::transfer(IORequest& request)
+{
+  ssize_t result;
+  do {
+    result = request.write
+      ? pwritev(request.fd, request.iov, request.iovcnt, request.offset)
+      : preadv(request.fd, request.iov, request.iovcnt, request.offset);
+  } while (result < 0 && errno == EINTR);
+  request.batch->complete(request, result < 0 ? -errno : result);
+}
+
+
+//-------------------------------------------------------------------
+// SyncBackend
+//-------------------------------------------------------------------
+
+void SyncBackend::submit(IORequest* requests, const int n, IOBatch& batch)
+{
+  enlist(requests, n, batch);
+  for (int i = 0; i < n; i++)
+    transfer(requests[i]);
+}
+
+
+//-------------------------------------------------------------------
+// ThreadBackend
+//-------------------------------------------------------------------
+
+ThreadBackend::ThreadBackend(const int numThreads) : stop(false)
+{
+  pthread_mutex_init(&lock, NULL);
+  pthread_cond_init(&wake, NULL);
+  for (int i = 0; i < numThreads; i++) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, workerMain, this) == 0)
+      workers.push_back(thread);
+  }
+}
+
+ThreadBackend::~ThreadBackend()
+{
+  pthread_mutex_lock(&lock);
+  stop = true;
+  pthread_cond_broadcast(&wake);
+  pthread_mutex_unlock(&lock);
+  for (int i = 0; i < (int)workers.size(); i++)
+    pthread_join(workers[i], NULL);
+  pthread_cond_destroy(&wake);
+  pthread_mutex_destroy(&lock);
+}
+
+void ThreadBackend::submit(IORequest* requests, const int n, IOBatch& batch)
+{
+  enlist(requests, n, batch);
+  if (workers.empty()) {
+    // no thread could be started: do the work here
+    for (int i = 0; i < n; i++)
+      transfer(requests[i]);
+    return;
+  }
+  pthread_mutex_lock(&lock);
+  for (int i = 0; i < n; i++)
+    queue.push_back(&requests[i]);
+  if (n == 1)
+    pthread_cond_signal(&wake);
+  else
+    pthread_cond_broadcast(&wake);
+  pthread_mutex_unlock(&lock);
+}
+
+void* ThreadBackend::workerMain(void* backend)
+{
+  ThreadBackend* self = (ThreadBackend*)backend;
+  pthread_mutex_lock(&self->lock);
+  for (;;) {
+    // requests still queued are finished before stopping
+    if (self->queue.empty()) {
+      if (self->stop)
+	break;
+      pthread_cond_wait(&self->wake, &self->lock);
+      continue;
+    }
+    IORequest* request = self->queue.front();
+    self->queue.pop_front();
+    pthread_mutex_unlock(&self->lock);
+    transfer(*request);
+    pthread_mutex_lock(&self->lock);
+  }
+  pthread_mutex_unlock(&self->lock);
+  return NULL;
+}
+
+
+//-------------------------------------------------------------------
+// UringBackend
+//-------------------------------------------------------------------
+
+UringBackend::UringBackend(const int entries)
+  : ringFd(-1), entries(entries), sqRing(MAP_FAILED), sqRingSize(0),
+    cqRing(MAP_FAILED), cqRingSize(0), sqes(MAP_FAILED), inFlight(0),
+    unsubmitted(0), reaperRunning(false)
+{
+  pthread_mutex_init(&sqLock, NULL);
+  pthread_cond_init(&slotFree, NULL);
+}
+
+#if defined(__linux__) && defined(__NR_io_uring_setup)
+
+const Status UringBackend::setup()
+{
+  struct io_uring_params params;
+  memset(&params, 0, sizeof params);
+  ringFd = syscall(__NR_io_uring_setup, entries, &params);
+  if (ringFd < 0)
+    return UNIXERR;
+  // the kernel rounds the queue up, and the completion queue is at
+  // least as long, so every submitted entry has room to complete
+  entries = params.sq_entries;
+
+  sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    if (cqRingSize > sqRingSize)
+      sqRingSize = cqRingSize;
+    cqRingSize = 0;
+  }
+  sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+  if (sqRing == MAP_FAILED)
+    return UNIXERR;
+  if (cqRingSize == 0)
+    cqRing = sqRing;
+  else {
+    cqRing = mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE,
+		  MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+    if (cqRing == MAP_FAILED)
+      return UNIXERR;
+  }
+  sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe),
+	      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd,
+	      IORING_OFF_SQES);
+  if (sqes == MAP_FAILED)
+    return UNIXERR;
+
+  char* sq = (char*)sqRing;
+  char* cq = (char*)cqRing;
+  sqHead = (unsigned*)(sq + params.sq_off.head);
+  sqTail = (unsigned*)(sq + params.sq_off.tail);
+  sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+  sqArray = (unsigned*)(sq + params.sq_off.array);
+  cqHead = (unsigned*)(cq + params.cq_off.head);
+  cqTail = (unsigned*)(cq + params.cq_off.tail);
+  cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+  cqes = cq + params.cq_off.cqes;
+
+  if (pthread_create(&reaper, NULL, reaperMain, this) != 0)
+    return UNIXERR;
+  reaperRunning = true;
+  return OK;
+}
+
+UringBackend::~UringBackend()
+{
+  if (reaperRunning) {
+    // a no-op without a request tells the reaper to finish up
+    pthread_mutex_lock(&sqLock);
+    push(NULL, IORING_OP_NOP);
+    enter(unsubmitted, 0);
+    pthread_mutex_unlock(&sqLock);
+    pthread_join(reaper, NULL);
+  }
+  if (sqes != MAP_FAILED)
+    munmap(sqes, entries * sizeof(struct io_uring_sqe));
+  if (cqRing != MAP_FAILED && cqRing != sqRing)
+    munmap(cqRing, cqRingSize);
+  if (sqRing != MAP_FAILED)
+    munmap(sqRing, sqRingSize);
+  if (ringFd >= 0)
+    close(ringFd);
+  pthread_cond_destroy(&slotFree);
+  pthread_mutex_destroy(&sqLock);
+}
+
+void UringBackend::submit(IORequest* requests, const int n, IOBatch& batch)
+{
+  enlist(requests, n, batch);
+  pthread_mutex_lock(&sqLock);
+  for (int i = 0; i < n; i++) {
+    while (inFlight >= entries) {
+      // hand what is queued to the kernel before waiting for room
+      if (unsubmitted > 0)
+	enter(unsubmitted, 0);
+      pthread_cond_wait(&slotFree, &sqLock);
+    }
+    push(&requests[i], requests[i].write ? IORING_OP_WRITEV : IORING_OP_READV);
+  }
+  if (unsubmitted > 0)
+    enter(unsubmitted, 0);
+  pthread_mutex_unlock(&sqLock);
+}
+
+// fills the next submission queue entry; request NULL is a wake-up no-op
+void UringBackend::push(IORequest* request, const unsigned char opcode)
+{
+  unsigned tail = *sqTail;
+  unsigned index = tail & *sqMask;
+  struct io_uring_sqe* sqe = (struct io_uring_sqe*)sqes + index;
+  memset(sqe, 0, sizeof *sqe);
+  sqe->opcode = opcode;
+  sqe->user_data = (unsigned long)request;
+  if (request) {
+    sqe->fd = request->fd;
+    sqe->addr = (unsigned long)request->iov;
+    sqe->len = request->iovcnt;
+    sqe->off = request->offset;
+  } else
+    sqe->fd = -1;
+  sqArray[index] = index;
+  __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+  inFlight++;
+  unsubmitted++;
+}
+
+// submits toSubmit queued entries, optionally waiting for completions
+void UringBackend::enter(const unsigned toSubmit, const unsigned minComplete)
+{
+  unsigned flags = minComplete > 0 ? IORING_ENTER_GETEVENTS : 0;
+  int submitted;
+  do {
+    submitted = syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete,
+			flags, NULL, 0);
+  } while (submitted < 0 && errno == EINTR);
+  if (submitted > 0 && toSubmit > 0)
+    unsubmitted -= submitted;
+}
+
+void* UringBackend::reaperMain(void* backend)
+{
+  UringBackend* self = (UringBackend*)backend;
+  bool stopping = false;
+  while (!stopping) {
+    unsigned head = *self->cqHead;
+    unsigned tail = __atomic_load_n(self->cqTail, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+      int r = syscall(__NR_io_uring_enter, self->ringFd, 0, 1,
+		      IORING_ENTER_GETEVENTS, NULL, 0);
+      (void)r;
+      continue;
+    }
+    unsigned reaped = 0;
+    for (; head != tail; head++, reaped++) {
+      struct io_uring_cqe* cqe =
+	(struct io_uring_cqe*)self->cqes + (head & *self->cqMask);
+      IORequest* request = (IORequest*)cqe->user_data;
+      if (request)
+	request->batch->complete(*request, cqe->res);
+      else
+	stopping = true;
+    }
+    __atomic_store_n(self->cqHead, head, __ATOMIC_RELEASE);
+    pthread_mutex_lock(&self->sqLock);
+    self->inFlight -= reaped;
+    pthread_cond_broadcast(&self->slotFree);
+    pthread_mutex_unlock(&self->sqLock);
+  }
+  return NULL;
+}
+
+#else
+
+// io_uring is not available on this system
+
+const Status UringBackend::setup() { return UNIXERR; }
+UringBackend::~UringBackend()
+{
+  pthread_cond_destroy(&slotFree);
+  pthread_mutex_destroy(&sqLock);
+}
+void UringBackend::submit(IORequest* requests, const int n, IOBatch& batch) {}
+void UringBackend::push(IORequest* request, const unsigned char opcode) {}
+void UringBackend::enter(const unsigned toSubmit, const unsigned minComplete) {}
+void* UringBackend::reaperMain(void* backend) { return NULL; }
+
+#endif
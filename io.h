@@ -0,0 +1,158 @@
+#ifndef IO_H
+#define IO_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <pthread.h>
+#include <deque>
+#include <vector>
+#include "error.h"
+
+// Disk I/O backends.  Every read and write of a File goes through the
+// backend selected with IOBackend::select(): File builds one IORequest
+// per run of adjacent pages, submits a batch of them at once and waits
+// for the batch, so a batch of scattered pages keeps all its runs in
+// flight together on backends that can overlap them.
+
+enum IOKind { SYNCIO, THREADIO, URINGIO };
+
+class IOBatch;
+
+// one preadv or pwritev
+struct IORequest
+{
+  int		fd;       // file to transfer to or from
+  bool		write;    // pwritev if set, else preadv
+  off_t		offset;   // file offset of the first byte
+  struct iovec* iov;      // buffers, valid until the batch completes
+  int		iovcnt;   // number of buffers
+  size_t	length;   // total bytes; anything less is an error
+  IOBatch*	batch;    // set by IOBackend::submit
+};
+
+
+// Requests submitted together, and the completion they are waited on by
+class IOBatch
+{
+public:
+  IOBatch();
+  ~IOBatch();
+
+  // blocks until every request of the batch has completed; UNIXERR if
+  // any of them failed or transferred less than asked
+  const Status wait();
+
+  // called by the backend as each request completes with result bytes
+  // transferred, or -errno
+  void complete(const IORequest& request, const ssize_t result);
+
+private:
+  friend class IOBackend;
+  pthread_mutex_t lock;
+  pthread_cond_t  done;
+  int		  pending;   // requests not yet completed
+  bool		  failed;    // some request failed
+};
+
+
+class IOBackend
+{
+public:
+  // makes kind the backend of all files from now on; depth is the number
+  // of threads (THREADIO) or of requests in flight (URINGIO).  Meant to
+  // be called at startup, before any file is opened.  If the backend
+  // cannot be set up (no io_uring in the kernel, say), UNIXERR is
+  // returned and the previous backend stays in use.
+  static const Status select(const IOKind kind, const int depth = 32);
+  static IOBackend* get() { return current; }  // the selected backend
+
+  virtual ~IOBackend() {}
+
+  // starts n requests; each one completes through its batch
+  virtual void submit(IORequest* requests, const int n, IOBatch& batch) = 0;
+  virtual const char* name() const = 0;
+
+protected:
+  static void enlist(IORequest* requests, const int n, IOBatch& batch);
+  static void transfer(IORequest& request);  // perform it synchronously
+
+private:
+  static IOBackend* current;
+};
+
+
+// preadv/pwritev in the submitting thread: the batch is done by the
+// time submit returns
+class SyncBackend : public IOBackend
+{
+public:
+  void submit(IORequest* requests, const int n, IOBatch& batch);
+  const char* name() const { return "sync"; }
+};
+
+
+// a pool of threads, each performing one request at a time with
+// preadv/pwritev
+class ThreadBackend : public IOBackend
+{
+public:
+  ThreadBackend(const int numThreads);
+  ~ThreadBackend();
+
+  void submit(IORequest* requests, const int n, IOBatch& batch);
+  const char* name() const { return "threads"; }
+
+private:
+  static void* workerMain(void* backend);
+
+  std::vector<pthread_t>   workers;
+  pthread_mutex_t	   lock;      // protects queue and stop
+  pthread_cond_t	   wake;      // signalled when requests are queued
+  std::deque<IORequest*>   queue;
+  bool			   stop;
+};
+
+
+// Linux io_uring, driven through the raw system calls: submit fills
+// submission queue entries and enters the kernel once per batch, and a
+// reaper thread waits for completions and hands them to their batches.
+class UringBackend : public IOBackend
+{
+public:
+  UringBackend(const int entries);
+  ~UringBackend();
+
+  const Status setup();   // must succeed before the backend is used
+  void submit(IORequest* requests, const int n, IOBatch& batch);
+  const char* name() const { return "io_uring"; }
+
+private:
+  static void* reaperMain(void* backend);
+  void push(IORequest* request, const unsigned char opcode); // sqLock held
+  void enter(const unsigned toSubmit, const unsigned minComplete);
+
+  int		  ringFd;
+  unsigned	  entries;      // size of the submission queue
+  void*		  sqRing;       // mapped submission ring
+  size_t	  sqRingSize;
+  void*		  cqRing;       // mapped completion ring (may be sqRing)
+  size_t	  cqRingSize;
+  void*		  sqes;         // mapped submission queue entries
+  unsigned*	  sqHead;
+  unsigned*	  sqTail;
+  unsigned*	  sqMask;
+  unsigned*	  sqArray;
+  unsigned*	  cqHead;
+  unsigned*	  cqTail;
+  unsigned*	  cqMask;
+  void*		  cqes;
+
+  pthread_mutex_t sqLock;       // protects the submission side and inFlight
+  pthread_cond_t  slotFree;     // signalled when requests complete
+  unsigned	  inFlight;     // submitted and not yet reaped
+  unsigned	  unsubmitted;  // queued entries the kernel has not seen
+  pthread_t	  reaper;
+  bool		  reaperRunning;
+};
+
+#endif
@@ -2,6 +2,9 @@
 #include <functional>
 #include <string>
 #include <iostream>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 using namespace std;
 #include "page.h"
 
@@ -12,6 +15,7 @@ void Page::init(int pageNo)
     slotCnt = 0; // no slots in use
     curPage = pageNo;
     freePtr=0; // offset of free space in data array
+    freeSlot = 0; // no free slots
 //    freeSpace=PAGESIZE-DPFIXED + sizeof(slot_t); // amount of space available
     freeSpace=PAGESIZE-DPFIXED; // amount of space available
 }
@@ -23,7 +27,7 @@ void Page::dumpPage() const
 
   cout << "curPage = " << curPage <<", nextPage = " << nextPage
        << "\nfreePtr = " << freePtr << ",  freeSpace = " << freeSpace 
-       << ", slotCnt = " << slotCnt << endl;
+       << ", slotCnt = " << slotCnt << ", freeSlot = " << freeSlot << endl;
     
     for (i=0;i>slotCnt;i--)
       cout << "slot[" << i << "].offset = " << slot[i].offset 
@@ -46,6 +50,30 @@ const short Page::getFreeSpace() const
 {
   return freeSpace;
 }
+
+const short Page::getFragmentedSpace() const
+{
+  return freeSpace - contigSpace();
+}
+
+// Squeeze out the holes left by deleted records.  The records are
+// copied out in slot order and back to the start of data[].
+
+void Page::compact()
+{
+    char buf[PAGESIZE];
+    int pos = 0;
+
+    for (int i = 0; i > slotCnt; i--)
+      if (slot[i].length >= 0)
+      {
+	memcpy(&buf[pos], &data[slot[i].offset], slot[i].length);
+	slot[i].offset = pos;
+	pos += slot[i].length;
+      }
+    memcpy(data, buf, pos);
+    freePtr = pos;
+}
     
 // Add a new record to the page. Returns OK if everything went OK
 // otherwise, returns NOSPACE if sufficient space does not exist
@@ -62,27 +90,25 @@ const Status Page::insertRecord(const Record & rec, RID& rid)
     if (spaceNeeded > freeSpace) return NOSPACE;
     else
     {
-        int i=0;
-    	// look for an empty slot
-    	while (i > slotCnt)
-    	{
-	    if (slot[i].length == -1) break;
-	    else i--;
-    	}
-	// at this point we have either found an empty slot 
-	// or i will be equal to slotCnt.  In either case,
-	// we can just use i as the slot index
-
-	// adjust free space
-	if (i == slotCnt) 
+        int i;
+
+	// the space is there, but may be scattered in holes
+	if (spaceNeeded > contigSpace()) compact();
+
+	// take the first slot off the chain of empty ones, or
+	// add a new slot if there is none
+	if (freeSlot == 0) 
 	{
 	    // using a new slot
+	    i = slotCnt;
 	    freeSpace -= spaceNeeded;
 	    slotCnt--; 
 	}
 	else 
 	{
 	    // reusing an existing slot 
+	    i = -(freeSlot - 1);
+	    unlinkSlot(i);
 	    freeSpace -= rec.length;
 	}
 
@@ -103,9 +129,22 @@ const Status Page::insertRecord(const Record & rec, RID& rid)
     }
 }
 
+// Take free slot i off the chain, linking its neighbours on the chain
+// to each other.
+
+void Page::unlinkSlot(const int i)
+{
+    short next = slot[i].offset;
+    short prev = -1 - slot[i].length;
+
+    if (prev == 0) freeSlot = next;
+    else slot[-(prev - 1)].offset = next;
+    if (next != 0) slot[-(next - 1)].length = -1 - prev;
+}
+
 // delete a record from a page. Returns OK if everything went OK
-// compacts remaining records but leaves hole in slot array
-// use bcopy and not memcpy to do the compaction
+// leaves a hole in the data area, to be squeezed out by a later
+// compaction, and in the slot array
 
 const Status Page::deleteRecord(const RID & rid)
 {
@@ -115,74 +154,44 @@ const Status Page::deleteRecord(const RID & rid)
     if ((slotNo > slotCnt) && (slot[slotNo].length > 0))
     {
 	// valid slot
+	int recLen = slot[slotNo].length; // length of record being deleted
 
-	// two major cases.  case (i) is the case that the record
-	// being deleted is the "last" record on the page.  This
-	// case is identified by the fact that slotNo == slotCnt+1;
-	// In this case the records do not need to be compacted.
-	// case (ii) occurs when the record being deleted has one
-	// or more records after it.  This case requires compaction.
-	// It is identified by the condition slotNo > slotCnt+1
-
-#if 0
-        // this doesn't work if last slot is not last physical
-        // record
-	if (slotNo == (slotCnt+1))
-	{
-	    // case (i) - no compaction required
-	    freePtr -= slot[slotNo].length;
-	    freeSpace += sizeof(slot_t)+ slot[slotNo].length;
+	// the record is only unlinked, unless it is the last one in
+	// data[] and freePtr can simply back up over it
+	if (slot[slotNo].offset + recLen == freePtr) freePtr -= recLen;
+	freeSpace += recLen;  // increase freespace by size of hole
+
+	// Now there are two cases:
+	if (slotNo == slotCnt + 1)
+
+	  // Case 1 : Slot being freed is at end of slot array. In this
+	  //          case we can compact the slot array. Note that we
+	  //          should even compact slots that might have been
+	  //          emptied previously.
+	  {
 	    slotCnt++;
-	    return OK;
-	}
-	else
-#endif
-	{
-	    // case (ii) - compaction required
-            int offset = slot[slotNo].offset; // offset of record being deleted
-	    int recLen = slot[slotNo].length; // length of record being deleted
-            char* recPtr = &data[offset];  // get a pointer to the record
-
-	    // get handle on next record
-	    int nextOffset = offset + recLen;
-	    char* nextRec = &data[nextOffset];
-
-	    int cnt = freePtr-nextOffset; // calculate number of bytes to move
-	    bcopy(nextRec, recPtr, cnt); // shift bytes to the left
-
-	    // now need to adjust offsets of all valid slots to the
-	    // 'right' of slot being removed by recLen (size of the hole)
-
-	    for(int i = 0; i > slotCnt; i--)
-	      if (slot[i].length >= 0 && slot[i].offset > slot[slotNo].offset)
-		slot[i].offset -= recLen;
-		
-	    freePtr -= recLen;  // back up free pointer
-	    freeSpace += recLen;  // increase freespace by size of hole
-
-	    // Now there are two cases:
-	    if (slotNo == slotCnt + 1)
-
-	      // Case 1 : Slot being freed is at end of slot array. In this
-	      //          case we can compact the slot array. Note that we
-	      //          should even compact slots that might have been
-	      //          emptied previously.
-	      do
-		{
-		  slotCnt++;
-		  freeSpace += sizeof(slot_t);
-		}
-	      while (slotCnt < 0 && slot[slotCnt + 1].length == -1);
-
-	    else
+	    freeSpace += sizeof(slot_t);
+	    // the empty slots given up come off the chain
+	    while (slotCnt < 0 && slot[slotCnt + 1].length < 0)
 	      {
-		// Case 2: Slot being freed is in middle of slot array. No
-		//         compaction can be done.
-		slot[slotNo].length = -1; // mark slot free
-		slot[slotNo].offset = 0;  // mark slot free
+		unlinkSlot(slotCnt + 1);
+		slotCnt++;
+		freeSpace += sizeof(slot_t);
 	      }
-	      return OK;
-	}
+	  }
+
+	else
+	  {
+	    // Case 2: Slot being freed is in middle of slot array. No
+	    //         compaction can be done. Push it on the front of
+	    //         the chain of free slots.
+	    if (freeSlot != 0)
+	      slot[-(freeSlot - 1)].length = -1 - (-slotNo + 1);
+	    slot[slotNo].length = -1; // mark slot free, first on the chain
+	    slot[slotNo].offset = freeSlot;
+	    freeSlot = -slotNo + 1;
+	  }
+	return OK;
     }
     else return INVALIDSLOTNO;
 }
@@ -196,10 +205,10 @@ const Status Page::firstRecord(RID& firstRid) const
     // find the first non-empty slot
     while (i > slotCnt)
     {
-	if (slot[i].length == -1) i--;
+	if (slot[i].length < 0) i--;
 	else break;
     }
-    if ((i == slotCnt) || (slot[i].length == -1)) return NORECORDS;
+    if ((i == slotCnt) || (slot[i].length < 0)) return NORECORDS;
     else
     {
 	// found a non-empty slot
@@ -222,10 +231,10 @@ const Status Page::nextRecord (const RID &curRid, RID& nextRid) const
     // find the first non-empty slot
     while (i > slotCnt)
     {
-	if (slot[i].length == -1) i--;
+	if (slot[i].length < 0) i--;
 	else break;
     }
-    if ((i <= slotCnt) || (slot[i].length == -1)) return ENDOFPAGE;
+    if ((i <= slotCnt) || (slot[i].length < 0)) return ENDOFPAGE;
     else
     {
 	// found a non-empty slot
@@ -251,3 +260,45 @@ const Status Page::getRecord(const RID & rid, Record & rec)
     }
     else return INVALIDSLOTNO;
 }
+
+// returns the records from slot # slotNo on in one pass over the slot
+// array.  Where SSE2 is available four slots are checked at a time.
+
+const Status Page::getRecords(int& slotNo, PageRecord recs[],
+			      const int maxRecs, int& count)
+{
+    int i = -slotNo; // convert to negative format
+
+    count = 0;
+#ifdef __SSE2__
+    while (i - 3 > slotCnt && count + 4 <= maxRecs)
+    {
+	// slots i-3 .. i lie in that order in memory; bit 4k+3 of the
+	// mask is the sign bit of the length of slot i-3+k, set if the
+	// slot is free
+	__m128i slots = _mm_loadu_si128((const __m128i*)&slot[i - 3]);
+	int freeMask = _mm_movemask_epi8(slots);
+	for (int k = 3; k >= 0; k--)
+	  if (!(freeMask & (1 << (4 * k + 3))))
+	  {
+	    PageRecord& rec = recs[count++];
+	    rec.rid.pageNo = curPage;
+	    rec.rid.slotNo = -(i - 3 + k);
+	    rec.data = &data[slot[i - 3 + k].offset];
+	    rec.length = slot[i - 3 + k].length;
+	  }
+	i -= 4;
+    }
+#endif
+    for (; i > slotCnt && count < maxRecs; i--)
+      if (slot[i].length >= 0)
+      {
+	PageRecord& rec = recs[count++];
+	rec.rid.pageNo = curPage;
+	rec.rid.slotNo = -i;
+	rec.data = &data[slot[i].offset];
+	rec.length = slot[i].length;
+      }
+    slotNo = -i;
+    return count == 0 ? ENDOFPAGE : OK;
+}
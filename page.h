@@ -17,23 +17,51 @@ struct Record
   int length;
 };
 
+// a record returned by Page::getRecords
+struct PageRecord
+{
+  RID rid;
+  void* data;
+  int length;
+};
+
 // slot structure
 struct slot_t {
         short	offset;  
         short	length;  // equals -1 if slot is not in use
 };
 
-const unsigned PAGESIZE = 1024;
+// The page size is chosen when the tree is built (make PAGESIZE=4096)
+// and recorded in the header of every file, which can then only be
+// opened by a build with the same page size.  Slot offsets are shorts.
+
+#ifndef DB_PAGESIZE
+#define DB_PAGESIZE 1024
+#endif
+#if DB_PAGESIZE % 512 != 0 || DB_PAGESIZE > 32768
+#error "DB_PAGESIZE must be a multiple of 512, at most 32768"
+#endif
+
+const unsigned PAGESIZE = DB_PAGESIZE;
 const unsigned DPFIXED= sizeof(slot_t)+4*sizeof(short)+2*sizeof(int);
 const unsigned PAGEDATASIZE = PAGESIZE-DPFIXED+sizeof(slot_t);
 // size of the data area of a page
 
 // Class definition for a minirel data page.   
-// The design assumes that records are kept compacted when
-// deletions are performed. Notice, however, that the slot
-// array cannot be compacted.  Notice, this class does not keep
-// the records align, relying instead on upper levels to take
-// care of non-aligned attributes
+// Deleting a record leaves a hole in the data area; the holes are
+// squeezed out all at once when an insert finds no room between the
+// records and the slot array, or when compact() is called. Notice,
+// however, that the slot array cannot be compacted.  Notice, this
+// class does not keep the records align, relying instead on upper
+// levels to take care of non-aligned attributes
+//
+// The free slots in the middle of the slot array are chained through
+// their offset fields, the slot freed last first, so that deleteRecord
+// and insertRecord take constant time.  Links are slot numbers plus one,
+// 0 ending the chain.  A free slot's length is -1 minus the link back to
+// the slot before it on the chain: -1 for the first one, and negative
+// for every free slot, so that the chain can also be unlinked from in
+// the middle when the slot array shrinks.
 
 class Page {
 private:
@@ -42,10 +70,17 @@ private:
     short	slotCnt; // number of slots in use;
     short	freePtr; // offset of first free byte in data[]
     short	freeSpace; // number of bytes free in data[]
-    short	dummy;	// for alignment purposes
+    short	freeSlot; // 1 + slot # of the slot freed last, 0 if none
     int		nextPage; // forwards pointer
     int		curPage;  // page number of current pointer
 
+    // bytes free between the last record and the slot array
+    short contigSpace() const
+    { return PAGESIZE - DPFIXED + slotCnt * sizeof(slot_t) - freePtr; }
+
+    // takes free slot i (in negative format) off the chain of free slots
+    void unlinkSlot(const int i);
+
 public:
     void init(const int pageNo); // initialize a new page
     void dumpPage() const;       // dump contents of a page
@@ -54,6 +89,12 @@ public:
     const Status setNextPage(const int pageNo); // sets value of nextPage to pageNo
     const short getFreeSpace() const; // returns amount of free space
 
+    // returns the free space left in holes by deleted records
+    const short getFragmentedSpace() const;
+
+    // moves the records together, leaving all free space contiguous
+    void compact();
+
     // inserts a new record (rec) into the page, returns RID of record 
     const Status insertRecord(const Record & rec, RID& rid);
 
@@ -70,6 +111,12 @@ public:
 
     // returns reference to record with RID rid
     const Status getRecord(const RID & rid, Record & rec);
+
+    // fills recs with up to maxRecs records, in slot order from slot #
+    // slotNo on, and advances slotNo past them; count is set to the
+    // number returned. returns ENDOFPAGE if there were none left
+    const Status getRecords(int& slotNo, PageRecord recs[],
+			    const int maxRecs, int& count);
 };
 
 #endif
@@ -0,0 +1,426 @@
+#include <iostream>
+#include "page.h"
+#include "replacer.h"
+
+// page replacement policy implementations
+
+
+Replacer* Replacer::create(const Replacement policy, BufDesc* frames,
+			   const int numFrames)
+{
+  switch (policy) {
+    case LRUK: return new LRUKReplacer(frames, numFrames);
+    case TWOQ: return new TwoQReplacer(frames, numFrames);
+    case ARC:  return new ARCReplacer(frames, numFrames);
+    case CLOCK:
+    default:   return new ClockReplacer(frames, numFrames);
+  }
+}
+
+
+//-------------------------------------------------------------------
+// FrameList and GhostList
+//-------------------------------------------------------------------
+
+void FrameList::pushFront(const int frame, std::vector<int>& prev,
+			  std::vector<int>& next)
+{
+  prev[frame] = -1;
+  next[frame] = head;
+  if (head >= 0) prev[head] = frame;
+  else tail = frame;
+  head = frame;
+  count++;
+}
+
+void FrameList::pushBack(const int frame, std::vector<int>& prev,
+			 std::vector<int>& next)
+{
+  next[frame] = -1;
+  prev[frame] = tail;
+  if (tail >= 0) next[tail] = frame;
+  else head = frame;
+  tail = frame;
+  count++;
+}
+
+void FrameList::remove(const int frame, std::vector<int>& prev,
+		       std::vector<int>& next)
+{
+  if (prev[frame] >= 0) next[prev[frame]] = next[frame];
+  else head = next[frame];
+  if (next[frame] >= 0) prev[next[frame]] = prev[frame];
+  else tail = prev[frame];
+  count--;
+}
+
+void GhostList::pushFront(const PageKey& key)
+{
+  remove(key);
+  order.push_front(key);
+  index[key] = order.begin();
+}
+
+void GhostList::popBack()
+{
+  index.erase(order.back());
+  order.pop_back();
+}
+
+bool GhostList::remove(const PageKey& key)
+{
+  std::map<PageKey, std::list<PageKey>::iterator>::iterator it = index.find(key);
+  if (it == index.end())
+    return false;
+  order.erase(it->second);
+  index.erase(it);
+  return true;
+}
+
+
+//-------------------------------------------------------------------
+// Clock
+//-------------------------------------------------------------------
+
+ClockReplacer::ClockReplacer(BufDesc* frames, const int numFrames)
+  : Replacer(frames, numFrames)
+{
+  clockHand = numFrames - 1;
+}
+
+void ClockReplacer::hit(const int frame)
+{
+  setRefbit(frame, true);
+}
+
+void ClockReplacer::loaded(const int frame, const File* file, const pageno_t pageNo)
+{
+  setRefbit(frame, true);
+}
+
+void ClockReplacer::loadedCold(const int frame, const File* file, const pageno_t pageNo)
+{
+  setRefbit(frame, false);
+}
+
+// Sweeps the clock, clearing reference bits, until it reaches an
+// unpinned frame whose bit is already clear.  Two full turns are enough
+// to clear every bit, so a longer sweep means every frame is pinned.
+// Frames without a page are passed over: they are either on BufMgr's
+// free list or already handed out for a page being read.
+int ClockReplacer::victim(const File* file, const pageno_t pageNo)
+{
+  for (int n = 0; n <= 2 * numFrames; n++) {
+    clockHand = (clockHand + 1) % numFrames;
+    if (getRefbit(clockHand))
+      setRefbit(clockHand, false);
+    else if (!isPinned(clockHand) && isValid(clockHand))
+      return clockHand;
+  }
+  return -1;
+}
+
+// the frames the hand reaches next
+int ClockReplacer::upcoming(int* frames, const int max) const
+{
+  int n = 0;
+  for (int f = (clockHand + 1) % numFrames; n < max && n < numFrames;
+       f = (f + 1) % numFrames)
+    frames[n++] = f;
+  return n;
+}
+
+
+//-------------------------------------------------------------------
+// LRU-K
+//-------------------------------------------------------------------
+
+LRUKReplacer::LRUKReplacer(BufDesc* frames, const int numFrames)
+  : Replacer(frames, numFrames), clock(0),
+    prevRef(numFrames, 0), lastRef(numFrames, 0)
+{
+}
+
+// records a reference to frame, moving it to its new place in order
+void LRUKReplacer::reference(const int frame)
+{
+  if (lastRef[frame] != 0) {
+    Key old = { prevRef[frame], lastRef[frame], frame };
+    order.erase(old);
+  }
+  prevRef[frame] = lastRef[frame];
+  lastRef[frame] = ++clock;
+  Key key = { prevRef[frame], lastRef[frame], frame };
+  order.insert(key);
+}
+
+void LRUKReplacer::hit(const int frame)
+{
+  reference(frame);
+}
+
+void LRUKReplacer::loaded(const int frame, const File* file, const pageno_t pageNo)
+{
+  reference(frame);
+}
+
+// gives the frame a last reference older than any real one, so it sorts
+// among the first victims
+void LRUKReplacer::loadedCold(const int frame, const File* file, const pageno_t pageNo)
+{
+  prevRef[frame] = 0;
+  lastRef[frame] = 1;
+  Key key = { 0, 1, frame };
+  order.insert(key);
+}
+
+int LRUKReplacer::victim(const File* file, const pageno_t pageNo)
+{
+  for (std::set<Key>::iterator it = order.begin(); it != order.end(); ++it)
+    if (!isPinned(it->frame))
+      return it->frame;
+  return -1;
+}
+
+int LRUKReplacer::upcoming(int* frames, const int max) const
+{
+  int n = 0;
+  for (std::set<Key>::const_iterator it = order.begin();
+       it != order.end() && n < max; ++it)
+    frames[n++] = it->frame;
+  return n;
+}
+
+void LRUKReplacer::evicted(const int frame)
+{
+  dropped(frame);
+}
+
+void LRUKReplacer::dropped(const int frame)
+{
+  if (lastRef[frame] == 0)
+    return;
+  Key key = { prevRef[frame], lastRef[frame], frame };
+  order.erase(key);
+  prevRef[frame] = lastRef[frame] = 0;
+}
+
+
+//-------------------------------------------------------------------
+// 2Q
+//-------------------------------------------------------------------
+
+TwoQReplacer::TwoQReplacer(BufDesc* frames, const int numFrames)
+  : Replacer(frames, numFrames),
+    prev(numFrames, -1), next(numFrames, -1), where(numFrames, 0),
+    keys(numFrames)
+{
+  // the sizes recommended by Johnson and Shasha
+  kin = numFrames / 4 > 0 ? numFrames / 4 : 1;
+  kout = numFrames / 2 > 0 ? numFrames / 2 : 1;
+}
+
+// least recently inserted unpinned frame on list, or -1
+int TwoQReplacer::lastUnpinned(const FrameList& list) const
+{
+  for (int f = list.tail; f >= 0; f = prev[f])
+    if (!isPinned(f))
+      return f;
+  return -1;
+}
+
+// appends frames of list, least recent first, to frames[n..max-1]
+int TwoQReplacer::fromTail(const FrameList& list, int* frames, int n,
+			   const int max) const
+{
+  for (int f = list.tail; f >= 0 && n < max; f = prev[f])
+    frames[n++] = f;
+  return n;
+}
+
+void TwoQReplacer::unlink(const int frame)
+{
+  if (where[frame] == 'i') a1in.remove(frame, prev, next);
+  else if (where[frame] == 'm') am.remove(frame, prev, next);
+  where[frame] = 0;
+}
+
+void TwoQReplacer::hit(const int frame)
+{
+  // a hit in a1in is most likely correlated with the first reference,
+  // so only am is kept in LRU order
+  if (where[frame] == 'm') {
+    am.remove(frame, prev, next);
+    am.pushFront(frame, prev, next);
+  }
+}
+
+void TwoQReplacer::loaded(const int frame, const File* file, const pageno_t pageNo)
+{
+  PageKey key = { file, pageNo };
+  keys[frame] = key;
+  if (a1out.remove(key)) {
+    am.pushFront(frame, prev, next);
+    where[frame] = 'm';
+  } else {
+    a1in.pushFront(frame, prev, next);
+    where[frame] = 'i';
+  }
+}
+
+void TwoQReplacer::loadedCold(const int frame, const File* file, const pageno_t pageNo)
+{
+  PageKey key = { file, pageNo };
+  keys[frame] = key;
+  a1in.pushBack(frame, prev, next);
+  where[frame] = 'i';
+}
+
+int TwoQReplacer::victim(const File* file, const pageno_t pageNo)
+{
+  bool fromA1in = a1in.count > kin || am.count == 0;
+  int frame = lastUnpinned(fromA1in ? a1in : am);
+  if (frame < 0)
+    frame = lastUnpinned(fromA1in ? am : a1in);
+  return frame;
+}
+
+int TwoQReplacer::upcoming(int* frames, const int max) const
+{
+  bool fromA1in = a1in.count > kin || am.count == 0;
+  int n = fromTail(fromA1in ? a1in : am, frames, 0, max);
+  return fromTail(fromA1in ? am : a1in, frames, n, max);
+}
+
+void TwoQReplacer::evicted(const int frame)
+{
+  if (where[frame] == 'i') {
+    a1out.pushFront(keys[frame]);
+    if (a1out.size() > kout)
+      a1out.popBack();
+  }
+  unlink(frame);
+}
+
+void TwoQReplacer::dropped(const int frame)
+{
+  unlink(frame);
+}
+
+
+//-------------------------------------------------------------------
+// ARC
+//-------------------------------------------------------------------
+
+ARCReplacer::ARCReplacer(BufDesc* frames, const int numFrames)
+  : Replacer(frames, numFrames), p(0),
+    prev(numFrames, -1), next(numFrames, -1), where(numFrames, 0),
+    keys(numFrames)
+{
+}
+
+// least recently used unpinned frame on list, or -1
+int ARCReplacer::lastUnpinned(const FrameList& list) const
+{
+  for (int f = list.tail; f >= 0; f = prev[f])
+    if (!isPinned(f))
+      return f;
+  return -1;
+}
+
+// appends frames of list, least recent first, to frames[n..max-1]
+int ARCReplacer::fromTail(const FrameList& list, int* frames, int n,
+			  const int max) const
+{
+  for (int f = list.tail; f >= 0 && n < max; f = prev[f])
+    frames[n++] = f;
+  return n;
+}
+
+void ARCReplacer::unlink(const int frame)
+{
+  if (where[frame] == '1') t1.remove(frame, prev, next);
+  else if (where[frame] == '2') t2.remove(frame, prev, next);
+  where[frame] = 0;
+}
+
+void ARCReplacer::hit(const int frame)
+{
+  unlink(frame);
+  t2.pushFront(frame, prev, next);
+  where[frame] = '2';
+}
+
+// Adapts p when the page is found on a ghost list, as ARC does on a
+// miss.  Here this happens after the victim was chosen, so the REPLACE
+// step sees p as it was before this request.
+void ARCReplacer::loaded(const int frame, const File* file, const pageno_t pageNo)
+{
+  PageKey key = { file, pageNo };
+  keys[frame] = key;
+
+  if (b1.contains(key)) {
+    int delta = b1.size() >= b2.size() ? 1 : b2.size() / b1.size();
+    p = p + delta < numFrames ? p + delta : numFrames;
+    b1.remove(key);
+    t2.pushFront(frame, prev, next);
+    where[frame] = '2';
+  } else if (b2.contains(key)) {
+    int delta = b2.size() >= b1.size() ? 1 : b1.size() / b2.size();
+    p = p - delta > 0 ? p - delta : 0;
+    b2.remove(key);
+    t2.pushFront(frame, prev, next);
+    where[frame] = '2';
+  } else {
+    // keep the history bounded: |T1| + |B1| <= c and the whole
+    // directory <= 2c
+    while (b1.size() > 0 && t1.count + b1.size() >= numFrames)
+      b1.popBack();
+    while (b2.size() > 0
+	   && t1.count + t2.count + b1.size() + b2.size() >= 2 * numFrames)
+      b2.popBack();
+    t1.pushFront(frame, prev, next);
+    where[frame] = '1';
+  }
+}
+
+void ARCReplacer::loadedCold(const int frame, const File* file, const pageno_t pageNo)
+{
+  PageKey key = { file, pageNo };
+  keys[frame] = key;
+  t1.pushBack(frame, prev, next);
+  where[frame] = '1';
+}
+
+int ARCReplacer::victim(const File* file, const pageno_t pageNo)
+{
+  PageKey key = { file, pageNo };
+  bool fromT1 = t1.count > 0
+    && (t1.count > p || (b2.contains(key) && t1.count == p));
+  int frame = lastUnpinned(fromT1 ? t1 : t2);
+  if (frame < 0)
+    frame = lastUnpinned(fromT1 ? t2 : t1);
+  return frame;
+}
+
+int ARCReplacer::upcoming(int* frames, const int max) const
+{
+  bool fromT1 = t1.count > 0 && t1.count > p;
+  int n = fromTail(fromT1 ? t1 : t2, frames, 0, max);
+  return fromTail(fromT1 ? t2 : t1, frames, n, max);
+}
+
+void ARCReplacer::evicted(const int frame)
+{
+  if (where[frame] == '1') b1.pushFront(keys[frame]);
+  else if (where[frame] == '2') b2.pushFront(keys[frame]);
+  unlink(frame);
+  // a run of ghost hits never reaches the trimming in loaded()
+  if (b1.size() > numFrames) b1.popBack();
+  if (b2.size() > numFrames) b2.popBack();
+}
+
+void ARCReplacer::dropped(const int frame)
+{
+  unlink(frame);
+}
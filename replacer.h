@@ -0,0 +1,240 @@
+#ifndef REPLACER_H
+#define REPLACER_H
+
+#include <list>
+#include <map>
+#include <set>
+#include <vector>
+#include "buf.h"
+
+// Page replacement policies.  Each buffer pool shard owns one Replacer,
+// which decides which of the shard's frames to evict.  Frames are
+// numbered 0..numFrames-1 within the shard, and all calls are made with
+// the shard latch held.  The replacer only tracks frames that hold a
+// page; BufMgr hands out empty frames on its own.
+
+class Replacer
+{
+public:
+  // builds the replacer implementing policy for the numFrames frames
+  // starting at frames
+  static Replacer* create(const Replacement policy, BufDesc* frames,
+			  const int numFrames);
+  virtual ~Replacer() {}
+
+  // page in frame was accessed again (buffer hit)
+  virtual void hit(const int frame) = 0;
+
+  // page (file, pageNo) was just brought into frame
+  virtual void loaded(const int frame, const File* file, const pageno_t pageNo) = 0;
+
+  // page (file, pageNo) was brought into frame by a scan; it is placed
+  // where it will be evicted first instead of counting as referenced
+  virtual void loadedCold(const int frame, const File* file, const pageno_t pageNo) = 0;
+
+  // chooses an unpinned frame to evict so that (file, pageNo) can be
+  // loaded, or returns -1 if every frame is pinned.  Nothing changes until
+  // evicted() confirms the choice.
+  virtual int victim(const File* file, const pageno_t pageNo) = 0;
+
+  // page in frame, returned by victim(), has been evicted
+  virtual void evicted(const int frame) = 0;
+
+  // page in frame left the pool without being evicted (disposed of, or
+  // its file was flushed); it is forgotten rather than remembered
+  virtual void dropped(const int frame) = 0;
+
+  // fills frames with up to max frames in the order the policy expects to
+  // evict them, pinned ones included, and returns how many it filled in.
+  // Used by the background writer to clean pages before they are needed.
+  virtual int upcoming(int* frames, const int max) const = 0;
+
+  // number of pages no longer in the pool that the policy still
+  // remembers (its ghost lists)
+  virtual int remembered() const { return 0; }
+
+protected:
+  Replacer(BufDesc* frames, const int numFrames)
+    : frames(frames), numFrames(numFrames) {}
+
+  bool isPinned(const int frame) const { return frames[frame].pinCnt > 0; }
+  bool isValid(const int frame) const { return frames[frame].valid; }
+  bool getRefbit(const int frame) const { return frames[frame].refbit; }
+  void setRefbit(const int frame, const bool ref) { frames[frame].refbit = ref; }
+
+  BufDesc* frames;      // descriptors of the shard's frames
+  int	   numFrames;   // number of frames in the shard
+};
+
+
+// Doubly linked list of frames threaded through per-frame arrays, so that
+// moving a frame between lists or to the front is O(1) and allocation free.
+// The head is the most recently inserted frame.
+class FrameList
+{
+public:
+  FrameList() : head(-1), tail(-1), count(0) {}
+
+  void pushFront(const int frame, std::vector<int>& prev, std::vector<int>& next);
+  void pushBack(const int frame, std::vector<int>& prev, std::vector<int>& next);
+  void remove(const int frame, std::vector<int>& prev, std::vector<int>& next);
+
+  int head;    // most recent frame, -1 if empty
+  int tail;    // least recent frame, -1 if empty
+  int count;   // number of frames on the list
+};
+
+
+// identity of a page that has left the pool but is still remembered
+struct PageKey
+{
+  const File* file;
+  pageno_t    pageNo;
+
+  bool operator < (const PageKey& other) const
+  {
+    return file < other.file || (file == other.file && pageNo < other.pageNo);
+  }
+};
+
+
+// FIFO of remembered (ghost) pages with O(log n) membership test
+class GhostList
+{
+public:
+  void pushFront(const PageKey& key);
+  void popBack();
+  bool remove(const PageKey& key);    // true if key was on the list
+  bool contains(const PageKey& key) const { return index.count(key) != 0; }
+  int  size() const { return (int)index.size(); }
+
+private:
+  std::list<PageKey> order;    // most recent at the front
+  std::map<PageKey, std::list<PageKey>::iterator> index;
+};
+
+
+// Single reference bit clock: the policy BufMgr has always used.
+class ClockReplacer : public Replacer
+{
+public:
+  ClockReplacer(BufDesc* frames, const int numFrames);
+
+  void hit(const int frame);
+  void loaded(const int frame, const File* file, const pageno_t pageNo);
+  void loadedCold(const int frame, const File* file, const pageno_t pageNo);
+  int  victim(const File* file, const pageno_t pageNo);
+  void evicted(const int frame) {}
+  void dropped(const int frame) {}
+  int  upcoming(int* frames, const int max) const;
+
+private:
+  int clockHand;
+};
+
+
+// LRU-K with K = 2: evicts the frame whose second most recent reference
+// is oldest; frames referenced only once go first, in LRU order.  No
+// history is retained for pages after they leave the pool.
+class LRUKReplacer : public Replacer
+{
+public:
+  LRUKReplacer(BufDesc* frames, const int numFrames);
+
+  void hit(const int frame);
+  void loaded(const int frame, const File* file, const pageno_t pageNo);
+  void loadedCold(const int frame, const File* file, const pageno_t pageNo);
+  int  victim(const File* file, const pageno_t pageNo);
+  void evicted(const int frame);
+  void dropped(const int frame);
+  int  upcoming(int* frames, const int max) const;
+
+private:
+  struct Key
+  {
+    long kth;    // time of the K-th most recent reference, 0 if fewer
+    long last;   // time of the most recent reference
+    int	 frame;
+
+    bool operator < (const Key& other) const
+    {
+      if (kth != other.kth) return kth < other.kth;
+      if (last != other.last) return last < other.last;
+      return frame < other.frame;
+    }
+  };
+  void reference(const int frame);
+
+  long		    clock;      // logical time, one tick per reference
+  std::vector<long> prevRef;    // per frame: time of the previous reference
+  std::vector<long> lastRef;    // per frame: time of the last reference, 0 if empty
+  std::set<Key>	    order;      // resident frames, next victim first
+};
+
+
+// Full 2Q: new pages enter the A1in FIFO; a page re-requested while it is
+// remembered on the A1out ghost FIFO is promoted to the Am LRU list.  Pages
+// touched only by a scan therefore never displace the Am working set.
+class TwoQReplacer : public Replacer
+{
+public:
+  TwoQReplacer(BufDesc* frames, const int numFrames);
+
+  void hit(const int frame);
+  void loaded(const int frame, const File* file, const pageno_t pageNo);
+  void loadedCold(const int frame, const File* file, const pageno_t pageNo);
+  int  victim(const File* file, const pageno_t pageNo);
+  void evicted(const int frame);
+  void dropped(const int frame);
+  int  upcoming(int* frames, const int max) const;
+  int  remembered() const { return a1out.size(); }
+
+private:
+  int  lastUnpinned(const FrameList& list) const;
+  int  fromTail(const FrameList& list, int* frames, int n, const int max) const;
+  void unlink(const int frame);
+
+  int		     kin;        // target size of A1in
+  int		     kout;       // capacity of A1out
+  std::vector<int>   prev, next; // links for a1in and am
+  std::vector<char>  where;      // per frame: 0 if empty, else 'i' or 'm'
+  std::vector<PageKey> keys;     // page held by each frame
+  FrameList	     a1in;       // FIFO of pages seen once
+  FrameList	     am;         // LRU of pages seen again
+  GhostList	     a1out;      // pages recently evicted from a1in
+};
+
+
+// Adaptive Replacement Cache: balances a recency list T1 against a
+// frequency list T2, moving the target size p of T1 whenever a page
+// remembered on one of the ghost lists B1/B2 is requested again.
+class ARCReplacer : public Replacer
+{
+public:
+  ARCReplacer(BufDesc* frames, const int numFrames);
+
+  void hit(const int frame);
+  void loaded(const int frame, const File* file, const pageno_t pageNo);
+  void loadedCold(const int frame, const File* file, const pageno_t pageNo);
+  int  victim(const File* file, const pageno_t pageNo);
+  void evicted(const int frame);
+  void dropped(const int frame);
+  int  upcoming(int* frames, const int max) const;
+  int  remembered() const { return b1.size() + b2.size(); }
+
+private:
+  int  lastUnpinned(const FrameList& list) const;
+  int  fromTail(const FrameList& list, int* frames, int n, const int max) const;
+  void unlink(const int frame);
+
+  int		     p;          // target size of t1
+  std::vector<int>   prev, next; // links for t1 and t2
+  std::vector<char>  where;      // per frame: 0 if empty, else '1' or '2'
+  std::vector<PageKey> keys;     // page held by each frame
+  FrameList	     t1;         // resident pages seen once recently
+  FrameList	     t2;         // resident pages seen at least twice
+  GhostList	     b1;         // pages recently evicted from t1
+  GhostList	     b2;         // pages recently evicted from t2
+};
+
+#endif
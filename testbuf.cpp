@@ -3,9 +3,12 @@
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include <iostream>
 #include "page.h"
 #include "buf.h"
+#include "io.h"
+#include "heapfile.h"
 
 
 #define CALL(c)    { Status s; \
@@ -27,22 +30,96 @@
 		     }
 
 BufMgr*     bufMgr;
+DB          db;
 
-int main()
+// Reads and unpins page pageNo of a file of filePages pages, returning
+// the page this evicted, or 0 if none.  Unpinning a page that is not
+// pinned tells whether it is cached without the replacer noticing.
+
+static pageno_t accessPage(File* file, const pageno_t pageNo, const int filePages)
+{
+  Error error;
+  Page* page;
+  vector<bool> cached(filePages + 1);
+  for (pageno_t p = 1; p <= filePages; p++)
+    cached[p] = bufMgr->unPinPage(file, p, false) == PAGENOTPINNED;
+  CALL(bufMgr->readPage(file, pageNo, page));
+  CALL(bufMgr->unPinPage(file, pageNo, false));
+  for (pageno_t p = 1; p <= filePages; p++)
+    if (cached[p] && bufMgr->unPinPage(file, p, false) != PAGENOTPINNED)
+      return p;
+  return 0;
+}
+
+// One of the threads reading and writing a file at once: each owns some
+// pages, which only it writes, and reads the shared pages, which nobody
+// writes, while one of its own is pinned.
+
+struct Worker
+{
+  pthread_t thread;
+  int id;
+  File* file;
+  vector<pageno_t> own;      // pages written by this thread
+  const pageno_t* shared;    // pages read by every thread
+  int numShared;
+  int rounds;
+};
+
+static void* runWorker(void* arg)
+{
+  Error error;
+  Worker* w = (Worker*)arg;
+  Page* page;
+  Page* page2;
+  char expect[PAGESIZE];
+
+  for (int round = 0; round < w->rounds; round++) {
+    for (int k = 0; k < (int)w->own.size(); k++) {
+      const pageno_t p = w->own[k];
+      CALL(bufMgr->readPage(w->file, p, page));
+      sprintf(expect, "test.7 Page %lld thread %d round %d", p, w->id, round - 1);
+      ASSERT(strcmp((char*)page, expect) == 0);
+      const pageno_t q = w->shared[(7 * k + round + w->id) % w->numShared];
+      CALL(bufMgr->readPage(w->file, q, page2));
+      sprintf(expect, "test.7 Page %lld shared", q);
+      ASSERT(strcmp((char*)page2, expect) == 0);
+      sprintf((char*)page, "test.7 Page %lld thread %d round %d", p, w->id, round);
+      CALL(bufMgr->unPinPage(w->file, q, false));
+      CALL(bufMgr->unPinPage(w->file, p, true));
+    }
+  }
+  return NULL;
+}
+
+// The tests run on the I/O backend named by the first argument: sync
+// (the default), threads or uring.
+
+int main(int argc, char* argv[])
 {
 
   struct stat statusBuf;
 
+    if (argc > 1) {
+      string kind = argv[1];
+      Status status = IOBackend::select(kind == "uring" ? URINGIO :
+					kind == "threads" ? THREADIO : SYNCIO);
+      if (status != OK) {
+	cerr << "I/O backend " << kind << " is not available" << endl;
+	exit(1);
+      }
+      cout << "Using the " << IOBackend::get()->name() << " I/O backend" << endl;
+    }
+
 
     Error       error;
-    DB          db;
     File*	file1;
     File*	file2;
     File* 	file3;
     File*   file4;
     int		i;
     const int   num = 100;
-    int         j[num];    
+    pageno_t    j[num];    
 
     // create buffer manager
 
@@ -74,6 +151,42 @@ int main()
     else
       (void)db.destroyFile("test.4");
 
+    lstat("test.5", &statusBuf);
+    if (errno == ENOENT)
+      errno = 0;
+    else
+      (void)db.destroyFile("test.5");
+
+    lstat("test.6", &statusBuf);
+    if (errno == ENOENT)
+      errno = 0;
+    else
+      (void)db.destroyFile("test.6");
+
+    lstat("test.7", &statusBuf);
+    if (errno == ENOENT)
+      errno = 0;
+    else
+      (void)db.destroyFile("test.7");
+
+    lstat("test.8", &statusBuf);
+    if (errno == ENOENT)
+      errno = 0;
+    else
+      (void)db.destroyFile("test.8");
+
+    lstat("test.9", &statusBuf);
+    if (errno == ENOENT)
+      errno = 0;
+    else
+      (void)db.destroyFile("test.9");
+
+    lstat("test.10", &statusBuf);
+    if (errno == ENOENT)
+      errno = 0;
+    else
+      (void)db.destroyFile("test.10");
+
     CALL(db.createFile("test.1"));
     ASSERT(db.createFile("test.1") == FILEEXISTS);
     CALL(db.createFile("test.2"));
@@ -91,12 +204,12 @@ int main()
     Page* page2;
     Page* page3;
       char  cmp[PAGESIZE];
-    int pageno, pageno2, pageno3;
+    pageno_t pageno, pageno2, pageno3;
 
     cout << "Allocating pages in a file..." << endl;
     for (i = 0; i < num; i++) {
       CALL(bufMgr->allocPage(file1, j[i], page));
-      sprintf((char*)page, "test.1 Page %d %7.1f", j[i], (float)j[i]);
+      sprintf((char*)page, "test.1 Page %lld %7.1f", j[i], (float)j[i]);
       CALL(bufMgr->unPinPage(file1, j[i], true));
     }
     cout <<"Test passed"<<endl<<endl;
@@ -104,7 +217,7 @@ int main()
     cout << "Reading pages back..." << endl;
     for (i = 0; i < num; i++) {
       CALL(bufMgr->readPage(file1, j[i], page));
-      sprintf((char*)&cmp, "test.1 Page %d %7.1f", j[i], (float)j[i]);
+      sprintf((char*)&cmp, "test.1 Page %lld %7.1f", j[i], (float)j[i]);
       ASSERT(memcmp(page, &cmp, strlen((char*)&cmp)) == 0);
       CALL(bufMgr->unPinPage(file1, j[i], false));
     }
@@ -119,19 +232,19 @@ int main()
     for (i = 0; i < num/3; i++) 
     {
       CALL(bufMgr->allocPage(file2, pageno2, page2));
-      sprintf((char*)page2, "test.2 Page %d %7.1f", pageno2, (float)pageno2);
+      sprintf((char*)page2, "test.2 Page %lld %7.1f", pageno2, (float)pageno2);
       CALL(bufMgr->allocPage(file3, pageno3, page3));
-      sprintf((char*)page3, "test.3 Page %d %7.1f", pageno3, (float)pageno3);
+      sprintf((char*)page3, "test.3 Page %lld %7.1f", pageno3, (float)pageno3);
       pageno = j[random() % num];
       CALL(bufMgr->readPage(file1, pageno, page));
-      sprintf((char*)&cmp, "test.1 Page %d %7.1f", pageno, (float)pageno);
+      sprintf((char*)&cmp, "test.1 Page %lld %7.1f", pageno, (float)pageno);
       ASSERT(memcmp(page, &cmp, strlen((char*)&cmp)) == 0);
       cout << (char*)page << endl;
       CALL(bufMgr->readPage(file2, pageno2, page2));
-      sprintf((char*)&cmp, "test.2 Page %d %7.1f", pageno2, (float)pageno2);
+      sprintf((char*)&cmp, "test.2 Page %lld %7.1f", pageno2, (float)pageno2);
       ASSERT(memcmp(page2, &cmp, strlen((char*)&cmp)) == 0);
       CALL(bufMgr->readPage(file3, pageno3, page3));
-      sprintf((char*)&cmp, "test.3 Page %d %7.1f", pageno3, (float)pageno3);
+      sprintf((char*)&cmp, "test.3 Page %lld %7.1f", pageno3, (float)pageno3);
       ASSERT(memcmp(page3, &cmp, strlen((char*)&cmp)) == 0);
       CALL(bufMgr->unPinPage(file1, pageno, true));
     }
@@ -201,19 +314,19 @@ int main()
     cout << "Test passed" <<endl<<endl;
  
 
-    CALL(bufMgr->allocPage(file4, i, page));
-    CALL(bufMgr->unPinPage(file4, i, true));
-    FAIL(status = bufMgr->unPinPage(file4, i, false));
+    CALL(bufMgr->allocPage(file4, pageno, page));
+    CALL(bufMgr->unPinPage(file4, pageno, true));
+    FAIL(status = bufMgr->unPinPage(file4, pageno, false));
     error.print(status);
 
     cout << "Test passed" <<endl<<endl;
 
     for (i = 0; i < num; i++) {
       CALL(bufMgr->allocPage(file4, j[i], page));
-      sprintf((char*)page, "test.4 Page %d %7.1f", j[i], (float)j[i]);
+      sprintf((char*)page, "test.4 Page %lld %7.1f", j[i], (float)j[i]);
     }
 
-    int tmp;
+    pageno_t tmp;
     FAIL(status = bufMgr->allocPage(file4, tmp, page));
     error.print(status);
 
@@ -263,6 +376,1147 @@ int main()
 	CALL(db.destroyFile("test.3"));
     CALL(db.destroyFile("test.4"));
 
+    cout << "\nScanning a large file through a ring while reading a hot set...\n";
+    cout << "Expected Result: ";
+    cout << "No hot page is evicted by the scan.\n\n";
+
+    File*   file5;
+    File*   file6;
+    const int hot = num / 2;
+    const int scanned = 4 * num;
+    CALL(db.createFile("test.5"));
+    CALL(db.createFile("test.6"));
+    CALL(db.openFile("test.5", file5));
+    CALL(db.openFile("test.6", file6));
+    for (i = 0; i < hot; i++) {
+      CALL(bufMgr->allocPage(file5, pageno, page));
+      sprintf((char*)page, "test.5 Page %lld %7.1f", pageno, (float)pageno);
+      CALL(bufMgr->unPinPage(file5, pageno, true));
+    }
+    for (i = 0; i < scanned; i++) {
+      CALL(bufMgr->allocPage(file6, pageno, page));
+      sprintf((char*)page, "test.6 Page %lld %7.1f", pageno, (float)pageno);
+      CALL(bufMgr->unPinPage(file6, pageno, true));
+    }
+    CALL(bufMgr->flushFile(file6));
+
+    // warm up the hot set, then interleave the scan with hot lookups
+    for (i = 1; i <= hot; i++) {
+      CALL(bufMgr->readPage(file5, i, page));
+      CALL(bufMgr->unPinPage(file5, i, false));
+    }
+    BufRing ring(8);
+    bufMgr->clearBufStats();
+    for (i = 1; i <= scanned; i++) {
+      CALL(bufMgr->readPage(file6, i, page2, ring));
+      sprintf((char*)&cmp, "test.6 Page %d %7.1f", i, (float)i);
+      ASSERT(memcmp(page2, &cmp, strlen((char*)&cmp)) == 0);
+      CALL(bufMgr->readPage(file5, 1 + i % hot, page));
+      sprintf((char*)&cmp, "test.5 Page %d %7.1f", 1 + i % hot, (float)(1 + i % hot));
+      ASSERT(memcmp(page, &cmp, strlen((char*)&cmp)) == 0);
+      CALL(bufMgr->unPinPage(file5, 1 + i % hot, false));
+      CALL(bufMgr->unPinPage(file6, i, false));
+    }
+    // every disk read was for the scan
+    ASSERT(bufMgr->getBufStats().diskreads == scanned);
+
+    bufMgr->clearBufStats();
+    for (i = 1; i <= hot; i++) {
+      CALL(bufMgr->readPage(file5, i, page));
+      CALL(bufMgr->unPinPage(file5, i, false));
+    }
+    ASSERT(bufMgr->getBufStats().diskreads == 0);
+
+    cout << "Test passed" <<endl<<endl;
+
+    cout << "\nPinning pages through handles...\n";
+    cout << "Expected Result: ";
+    cout << "Pages are unpinned when their handle goes away.\n\n";
+
+    {
+      PageHandle handle;
+      CALL(bufMgr->readPage(file5, 1, handle));
+      sprintf((char*)&cmp, "test.5 Page %d %7.1f", 1, (float)1);
+      ASSERT(memcmp(handle.page(), &cmp, strlen((char*)&cmp)) == 0);
+      PageHandle moved(std::move(handle));
+      ASSERT(!handle.isPinned() && moved.isPinned());
+      CALL(bufMgr->allocPage(file5, pageno, handle));
+      sprintf((char*)handle.page(), "test.5 Page %lld %7.1f", pageno, (float)pageno);
+      handle.setDirty();
+    }
+    FAIL(bufMgr->unPinPage(file5, 1, false));
+    FAIL(bufMgr->unPinPage(file5, pageno, false));
+    CALL(bufMgr->flushFile(file5));
+    CALL(bufMgr->readPage(file5, pageno, page));
+    sprintf((char*)&cmp, "test.5 Page %lld %7.1f", pageno, (float)pageno);
+    ASSERT(memcmp(page, &cmp, strlen((char*)&cmp)) == 0);
+    CALL(bufMgr->unPinPage(file5, pageno, false));
+
+    cout << "Test passed" <<endl<<endl;
+
+    cout << "\nAllocating pages with the header page cached...\n";
+    cout << "Expected Result: ";
+    cout << "The header is only written on flush and close, and survives reopening.\n\n";
+
+    pageno_t last = 0;
+    long saved = file5->getHeaderIOSaved();
+    for (i = 0; i < 10; i++)
+      CALL(file5->allocatePage(last));
+    ASSERT(file5->getHeaderIOSaved() - saved == 20);
+    CALL(db.closeFile(file5));
+    CALL(db.openFile("test.5", file5));
+    CALL(file5->allocatePage(pageno));
+    ASSERT(pageno == last + 1);
+    CALL(file5->getFirstPage(pageno));
+    ASSERT(pageno == 1);
+    CALL(bufMgr->flushFile(file5));
+    ASSERT(file5->getHeaderIOSaved() == 2);
+
+    cout << "Test passed" <<endl<<endl;
+
+    cout << "\nAllocating an extent of pages...\n";
+    cout << "Expected Result: ";
+    cout << "The pages are contiguous, pinned and zeroed, and read back after a flush.\n\n";
+
+    Page* extent[8];
+    Page* extent2[num];
+    bufMgr->clearBufStats();
+    CALL(bufMgr->allocPages(file5, 8, pageno, extent));
+    ASSERT(pageno == last + 2);
+    ASSERT(bufMgr->getBufStats().diskreads == 0);
+    memset(&cmp, 0, sizeof cmp);
+    for (i = 0; i < 8; i++) {
+      ASSERT(memcmp(extent[i], &cmp, sizeof cmp) == 0);
+      sprintf((char*)extent[i], "test.5 Page %lld %7.1f", pageno + i, (float)(pageno + i));
+    }
+    CALL(bufMgr->unPinPages(file5, pageno, 8, true));
+    CALL(bufMgr->flushFile(file5));
+    for (i = 0; i < 8; i++) {
+      CALL(bufMgr->readPage(file5, pageno + i, page));
+      sprintf((char*)&cmp, "test.5 Page %lld %7.1f", pageno + i, (float)(pageno + i));
+      ASSERT(memcmp(page, &cmp, strlen((char*)&cmp)) == 0);
+      CALL(bufMgr->unPinPage(file5, pageno + i, false));
+    }
+    CALL(file5->allocatePage(pageno2));
+    ASSERT(pageno2 == pageno + 8);
+
+    cout << "Test passed" <<endl<<endl;
+
+    cout << "\nDisposing of and reallocating pages...\n";
+    cout << "Expected Result: ";
+    cout << "Freed pages survive reopening and are reused, runs first.\n\n";
+
+    pageno_t end = pageno2;
+    for (i = 2; i <= 6; i++)
+      CALL(bufMgr->disposePage(file5, i));
+    FAIL(bufMgr->disposePage(file5, 4));
+    CALL(db.closeFile(file5));
+    CALL(db.openFile("test.5", file5));
+    // page 2 was taken for the free-space map, 3..6 are free
+    FAIL(file5->disposePage(2));
+    CALL(bufMgr->allocPages(file5, 3, pageno, extent));
+    ASSERT(pageno == 3);
+    CALL(bufMgr->unPinPages(file5, pageno, 3, true));
+    CALL(bufMgr->allocPage(file5, pageno, page));
+    ASSERT(pageno == 6);
+    memset(&cmp, 0, sizeof cmp);
+    ASSERT(memcmp(page, &cmp, sizeof cmp) == 0);
+    CALL(bufMgr->unPinPage(file5, pageno, true));
+    CALL(file5->allocatePage(pageno));
+    ASSERT(pageno == end + 1);
+
+    // a free page read ahead into the pool is reused in its frame
+    CALL(bufMgr->disposePage(file5, 4));
+    bufMgr->clearBufStats();
+    CALL(bufMgr->prefetch(file5, 3, 3));
+    for (i = 0; i < 1000 && bufMgr->getBufStats().prefetches == 0; i++)
+      usleep(1000);
+    ASSERT(bufMgr->getBufStats().prefetches == 1);
+    CALL(bufMgr->allocPage(file5, pageno, page));
+    ASSERT(pageno == 4);
+    ASSERT(memcmp(page, &cmp, sizeof cmp) == 0);
+    CALL(bufMgr->unPinPage(file5, pageno, true));
+
+    // pages for which no frame is found go back to the file
+    CALL(bufMgr->allocPages(file5, num, pageno, extent2));
+    FAIL(bufMgr->allocPage(file5, pageno2, page));
+    FAIL(bufMgr->allocPages(file5, 2, pageno2, extent));
+    CALL(bufMgr->unPinPages(file5, pageno, num, true));
+    CALL(file5->allocatePages(2, pageno2));
+    ASSERT(pageno2 == pageno + num);
+
+    cout << "Test passed" <<endl<<endl;
+
+    cout << "\nReading a mapped file...\n";
+    cout << "Expected Result: ";
+    cout << "Pages are read in place, without a frame, and still pinned.\n\n";
+
+    CALL(db.closeFile(file6));
+    CALL(db.openFile("test.6", file6, MAPPED));
+    bufMgr->clearBufStats();
+    for (i = 1; i <= 4 * num; i++) {
+      CALL(bufMgr->readPage(file6, i, page));
+      ASSERT(page < bufMgr->bufPool || page >= bufMgr->bufPool + num);
+      sprintf((char*)&cmp, "test.6 Page %d %7.1f", i, (float)i);
+      ASSERT(memcmp(page, &cmp, strlen((char*)&cmp)) == 0);
+      if (i > 1) CALL(bufMgr->unPinPage(file6, i, false));
+    }
+    ASSERT(bufMgr->getBufStats().diskreads == 0);
+    FAIL(bufMgr->flushFile(file6));
+    CALL(bufMgr->unPinPage(file6, 1, false));
+    FAIL(bufMgr->unPinPage(file6, 1, false));
+    CALL(bufMgr->flushFile(file6));
+
+    // pages freed in the mapping are not reused while it lasts, since
+    // reads of them would still go to it
+    CALL(bufMgr->disposePage(file6, 2));
+    CALL(bufMgr->disposePage(file6, 4));
+    CALL(bufMgr->allocPage(file6, pageno, page));
+    ASSERT(pageno == 4 * num + 1);
+    strcpy((char*)page, "REUSED");
+    CALL(bufMgr->unPinPage(file6, pageno, true));
+    CALL(bufMgr->readPage(file6, pageno, page));
+    ASSERT(page >= bufMgr->bufPool && page < bufMgr->bufPool + num);
+    ASSERT(strcmp((char*)page, "REUSED") == 0);
+    CALL(bufMgr->unPinPage(file6, pageno, false));
+    CALL(bufMgr->allocPages(file6, 2, pageno, extent));
+    ASSERT(pageno == 4 * num + 2);
+    CALL(bufMgr->unPinPages(file6, pageno, 2, true));
+    CALL(bufMgr->flushFile(file6));
+
+    cout << "Test passed" <<endl<<endl;
+
+    cout << "\nWriting and reading a file opened DIRECT...\n";
+    cout << "Expected Result: ";
+    cout << "Pages survive a round trip through O_DIRECT, aligned or not.\n\n";
+
+    CALL(db.createFile("test.7"));
+    status = db.openFile("test.7", file1, DIRECT);
+    if (PAGESIZE % DIRECTALIGN != 0) {
+      ASSERT(status == BADPAGESIZE);
+      cout << "Pages smaller than DIRECTALIGN, refused" <<endl<<endl;
+      CALL(db.destroyFile("test.7"));
+    }
+    else if (status == UNIXERR) {
+      cout << "O_DIRECT not supported here, skipped" <<endl<<endl;
+      CALL(db.destroyFile("test.7"));
+    }
+    else {
+      CALL(status);
+      for (i = 0; i < num; i++)
+	ASSERT((size_t)(bufMgr->bufPool + i) % DIRECTALIGN == 0);
+      for (i = 0; i < num; i++) {
+	CALL(bufMgr->allocPage(file1, j[i], page));
+	sprintf((char*)page, "test.7 Page %lld %7.1f", j[i], (float)j[i]);
+	CALL(bufMgr->unPinPage(file1, j[i], true));
+      }
+      CALL(db.closeFile(file1));
+      CALL(db.openFile("test.7", file1, DIRECT));
+      for (i = 0; i < num; i++) {
+	CALL(bufMgr->readPage(file1, j[i], page));
+	sprintf((char*)&cmp, "test.7 Page %lld %7.1f", j[i], (float)j[i]);
+	ASSERT(memcmp(page, &cmp, strlen((char*)&cmp)) == 0);
+	CALL(bufMgr->unPinPage(file1, j[i], false));
+      }
+      // a page buffer off the alignment O_DIRECT wants
+      char raw[PAGESIZE + 8];
+      Page* odd = (Page*)((size_t)raw % DIRECTALIGN ? raw : raw + 8);
+      CALL(file1->readPage(j[num / 2], odd));
+      sprintf((char*)&cmp, "test.7 Page %lld %7.1f", j[num / 2], (float)j[num / 2]);
+      ASSERT(memcmp(odd, &cmp, strlen((char*)&cmp)) == 0);
+      CALL(file1->writePage(j[num / 2], odd));
+      CALL(db.closeFile(file1));
+      CALL(db.destroyFile("test.7"));
+
+      cout << "Test passed" <<endl<<endl;
+    }
+
+    cout << "\nWriting pages back in the background while they are updated...\n";
+    cout << "Expected Result: ";
+    cout << "No update is lost, and flushing waits for the writer.\n\n";
+
+    CALL(db.createFile("test.7"));
+    CALL(db.openFile("test.7", file1));
+    for (i = 0; i < num / 2; i++) {
+      CALL(bufMgr->allocPage(file1, j[i], page));
+      CALL(bufMgr->unPinPage(file1, j[i], true));
+    }
+    bufMgr->clearBufStats();
+    CALL(bufMgr->startWriter(1, num));
+    for (int round = 0; round < 50; round++) {
+      for (i = 0; i < num / 2; i++) {
+	CALL(bufMgr->readPage(file1, j[i], page));
+	sprintf((char*)page, "test.7 Page %lld round %d", j[i], round);
+	CALL(bufMgr->unPinPage(file1, j[i], true));
+      }
+      if (round % 10 == 9) CALL(bufMgr->flushFile(file1));
+      usleep(200);
+    }
+    for (i = 0; i < 1000 && bufMgr->getBufStats().bgwrites == 0; i++)
+      usleep(1000);
+    ASSERT(bufMgr->getBufStats().bgwrites > 0);
+    bufMgr->stopWriter();
+    CALL(db.closeFile(file1));
+    CALL(db.openFile("test.7", file1));
+    char expect[PAGESIZE];
+    for (i = 0; i < num / 2; i++) {
+      CALL(file1->readPage(j[i], (Page*)&cmp));
+      sprintf(expect, "test.7 Page %lld round %d", j[i], 49);
+      ASSERT(strcmp((char*)&cmp, expect) == 0);
+    }
+
+    // pages disposed of and reused while the writer may be writing them;
+    // the first page disposed of becomes the map page
+    CALL(file1->allocatePage(pageno));
+    CALL(file1->disposePage(pageno));
+    CALL(bufMgr->startWriter(1, num));
+    for (int round = 0; round < 20; round++) {
+      for (i = 0; i < num / 2; i++) {
+	CALL(bufMgr->readPage(file1, j[i], page));
+	sprintf((char*)page, "test.7 Page %lld round %d", j[i], round);
+	CALL(bufMgr->unPinPage(file1, j[i], true));
+      }
+      usleep(500);
+      for (i = 2; i < 6; i++)
+	CALL(bufMgr->disposePage(file1, j[i]));
+      // the pages come back lowest first
+      for (i = 2; i < 6; i++) {
+	CALL(bufMgr->allocPage(file1, j[i], page));
+	sprintf((char*)page, "test.7 Page %lld round %d", j[i], round);
+	CALL(bufMgr->unPinPage(file1, j[i], true));
+      }
+    }
+    bufMgr->stopWriter();
+    CALL(db.closeFile(file1));
+    CALL(db.openFile("test.7", file1));
+    for (i = 0; i < num / 2; i++) {
+      CALL(file1->readPage(j[i], (Page*)&cmp));
+      sprintf(expect, "test.7 Page %lld round %d", j[i], 19);
+      ASSERT(strcmp((char*)&cmp, expect) == 0);
+    }
+    CALL(db.closeFile(file1));
+    CALL(db.destroyFile("test.7"));
+
+    cout << "Test passed" <<endl<<endl;
+
+    cout << "\nCounting the writes of evictions and of the background writer...\n";
+    cout << "Expected Result: ";
+    cout << "Dirty victims are written in the foreground, unless the writer got to them first.\n\n";
+
+    ASSERT(bufMgr->startWriter(0, num) == BADBUFFER);
+    ASSERT(bufMgr->startWriter(1, 0) == BADBUFFER);
+    CALL(db.createFile("test.7"));
+    CALL(db.openFile("test.7", file1));
+    CALL(file1->allocatePages(2 * num, pageno));
+    for (int withWriter = 0; withWriter < 2; withWriter++) {
+      CALL(bufMgr->flushFile(file1));
+      bufMgr->clearBufStats();
+      for (i = 0; i < num; i++) {
+	CALL(bufMgr->readPage(file1, pageno + i, page));
+	CALL(bufMgr->unPinPage(file1, pageno + i, true));
+      }
+      if (withWriter) {
+	CALL(bufMgr->startWriter(1, num));
+	ASSERT(bufMgr->startWriter(1, num) == BADBUFFER);
+	for (i = 0; i < 5000 && bufMgr->getBufStats().bgwrites < num; i++)
+	  usleep(1000);
+	bufMgr->stopWriter();
+	bufMgr->stopWriter();
+	ASSERT(bufMgr->getBufStats().bgwrites == num);
+      }
+      // reading as many other pages evicts every dirty one
+      for (i = num; i < 2 * num; i++) {
+	CALL(bufMgr->readPage(file1, pageno + i, page));
+	CALL(bufMgr->unPinPage(file1, pageno + i, false));
+      }
+      const BufStats stats = bufMgr->getBufStats();
+      ASSERT(stats.diskwrites == num);
+      ASSERT(stats.fgwrites == (withWriter ? 0 : num));
+      ASSERT(stats.bgwrites == (withWriter ? num : 0));
+    }
+    CALL(db.closeFile(file1));
+    CALL(db.destroyFile("test.7"));
+
+    cout << "Test passed" <<endl<<endl;
+
+    cout << "\nReading pages ahead...\n";
+    cout << "Expected Result: ";
+    cout << "Prefetched pages are hits, and sequential reads stay behind the readahead.\n\n";
+
+    {
+      const int filePages = num / 2;
+      CALL(db.createFile("test.7"));
+      CALL(db.openFile("test.7", file1));
+      CALL(file1->allocatePages(filePages, pageno));
+      const pageno_t lastPage = pageno + filePages - 1;
+      ASSERT(bufMgr->prefetch(file1, 0, 4) == BADPAGENO);
+
+      // a run with a page already cached, and one going past the end
+      bufMgr->clearBufStats();
+      CALL(bufMgr->readPage(file1, pageno + 1, page));
+      CALL(bufMgr->unPinPage(file1, pageno + 1, false));
+      CALL(bufMgr->prefetch(file1, pageno, 4));
+      CALL(bufMgr->prefetch(file1, lastPage - 1, 4));
+      for (i = 0; i < 5000 && bufMgr->getBufStats().prefetches < 5; i++)
+	usleep(1000);
+      ASSERT(bufMgr->getBufStats().prefetches == 5);
+      for (i = 0; i < 6; i++) {
+	pageno2 = i < 4 ? pageno + i : lastPage - 5 + i;
+	CALL(bufMgr->readPage(file1, pageno2, page));
+	CALL(bufMgr->unPinPage(file1, pageno2, false));
+      }
+      ASSERT(bufMgr->getBufStats().diskreads == 6);
+
+      // once a run of three reads is seen, every later page of the file
+      // is read ahead of the reader, who waits for each to be cached
+      CALL(bufMgr->flushFile(file1));
+      bufMgr->setReadAhead(8);
+      bufMgr->clearBufStats();
+      for (pageno2 = pageno; pageno2 <= lastPage; pageno2++) {
+	for (i = 0; i < 5000 && pageno2 >= pageno + 3
+	       && bufMgr->unPinPage(file1, pageno2, false) != PAGENOTPINNED; i++)
+	  usleep(1000);
+	CALL(bufMgr->readPage(file1, pageno2, page));
+	CALL(bufMgr->unPinPage(file1, pageno2, false));
+      }
+      ASSERT(bufMgr->getBufStats().diskreads == filePages);
+      ASSERT(bufMgr->getBufStats().prefetches == filePages - 3);
+
+      // nothing is read ahead of reads that skip pages, or once it is off
+      for (int on = 1; on >= 0; on--) {
+	CALL(bufMgr->flushFile(file1));
+	bufMgr->setReadAhead(on ? 8 : 0);
+	bufMgr->clearBufStats();
+	for (pageno2 = pageno; pageno2 <= lastPage; pageno2 += on ? 2 : 1) {
+	  CALL(bufMgr->readPage(file1, pageno2, page));
+	  CALL(bufMgr->unPinPage(file1, pageno2, false));
+	}
+	usleep(10000);
+	ASSERT(bufMgr->getBufStats().prefetches == 0);
+      }
+      CALL(db.closeFile(file1));
+      CALL(db.destroyFile("test.7"));
+    }
+
+    cout << "Test passed" <<endl<<endl;
+
+    cout << "\nReading runs of pages...\n";
+    cout << "Expected Result: ";
+    cout << "A run is pinned whole or not at all, its mapped pages in place.\n\n";
+
+    {
+      const int filePages = 2 * num;
+      CALL(db.createFile("test.7"));
+      CALL(db.openFile("test.7", file1));
+      for (i = 0; i < filePages; i++) {
+	CALL(bufMgr->allocPage(file1, j[i % num], page));
+	sprintf((char*)page, "test.7 Page %lld", j[i % num]);
+	CALL(bufMgr->unPinPage(file1, j[i % num], true));
+      }
+      CALL(bufMgr->flushFile(file1));
+      pageno = 1;
+      const pageno_t lastPage = pageno + filePages - 1;
+
+      // hits and misses, the misses read in one go
+      bufMgr->clearBufStats();
+      CALL(bufMgr->readPage(file1, pageno + 2, page));
+      CALL(bufMgr->readPages(file1, pageno, 8, extent));
+      ASSERT(bufMgr->getBufStats().diskreads == 8);
+      ASSERT(extent[2] == page);
+      for (i = 0; i < 8; i++) {
+	sprintf((char*)&cmp, "test.7 Page %lld", pageno + i);
+	ASSERT(strcmp((char*)extent[i], (char*)&cmp) == 0);
+      }
+      CALL(bufMgr->unPinPages(file1, pageno, 8, false));
+      CALL(bufMgr->unPinPage(file1, pageno + 2, false));
+      FAIL(bufMgr->unPinPages(file1, pageno, 8, false));
+
+      // a run needing more frames than are unpinned pins nothing, and
+      // leaves the page it hit pinned as before
+      CALL(bufMgr->readPage(file1, pageno + 1, page));
+      CALL(bufMgr->readPage(file1, lastPage, page));
+      ASSERT(bufMgr->readPages(file1, pageno, num, extent2) == BUFFEREXCEEDED);
+      CALL(bufMgr->unPinPage(file1, pageno + 1, false));
+      CALL(bufMgr->unPinPage(file1, lastPage, false));
+      for (i = 0; i < num; i++)
+	FAIL(bufMgr->unPinPage(file1, pageno + i, false));
+
+      // so does a run going past the end of the file
+      ASSERT(bufMgr->readPages(file1, lastPage - 1, 4, extent) == UNIXERR);
+      FAIL(bufMgr->unPinPage(file1, lastPage - 1, false));
+      FAIL(bufMgr->unPinPage(file1, lastPage, false));
+
+      // and none of their frames is lost
+      CALL(bufMgr->readPages(file1, pageno, num, extent2));
+      CALL(bufMgr->unPinPages(file1, pageno, num, false));
+
+      // a file already open is only mapped once none of its pages is
+      // pinned, and its dirty pages are written out first
+      CALL(bufMgr->readPage(file1, pageno, page));
+      strcpy((char*)page, "test.7 Page 1 updated");
+      ASSERT(db.openFile("test.7", file2, MAPPED) == PAGEPINNED);
+      CALL(bufMgr->unPinPage(file1, pageno, true));
+      CALL(db.openFile("test.7", file2, MAPPED));
+      ASSERT(file2 == file1);
+      CALL(bufMgr->readPage(file1, pageno, page));
+      ASSERT(page < bufMgr->bufPool || page >= bufMgr->bufPool + num);
+      ASSERT(strcmp((char*)page, "test.7 Page 1 updated") == 0);
+      CALL(bufMgr->unPinPage(file1, pageno, false));
+      CALL(db.closeFile(file2));
+
+      // the mapped pages of a run are pinned in place, also when the
+      // rest of the run is not in the mapping
+      CALL(file1->allocatePages(2, pageno2));
+      ASSERT(pageno2 == lastPage + 1);
+      CALL(bufMgr->readPages(file1, lastPage - 1, 4, extent));
+      for (i = 0; i < 4; i++)
+	ASSERT((extent[i] >= bufMgr->bufPool && extent[i] < bufMgr->bufPool + num) == (i >= 2));
+      for (i = 0; i < 2; i++) {
+	sprintf((char*)&cmp, "test.7 Page %lld", lastPage - 1 + i);
+	ASSERT(strcmp((char*)extent[i], (char*)&cmp) == 0);
+      }
+      FAIL(bufMgr->flushFile(file1));
+      CALL(bufMgr->unPinPages(file1, lastPage - 1, 4, false));
+      CALL(bufMgr->flushFile(file1));
+      // if the rest of the run fails, its mapped pages are not pinned
+      ASSERT(bufMgr->readPages(file1, lastPage - 1, 8, extent) == UNIXERR);
+      CALL(bufMgr->flushFile(file1));
+      CALL(db.closeFile(file1));
+      CALL(db.destroyFile("test.7"));
+    }
+
+    cout << "Test passed" <<endl<<endl;
+
+    cout << "\nReading and writing from several threads through a sharded pool and a single shard...\n";
+    cout << "Expected Result: ";
+    cout << "Every thread sees its own updates and the shared pages intact; no pin is left.\n";
+    cout << "Another file is flushed over and over meanwhile.\n\n";
+
+    for (int pass = 0; pass < 2; pass++) {
+      const int numWorkers = 4;
+      const int numShared = num / 2;
+      const int filePages = 2 * num;
+      BufMgr* single = bufMgr;
+      // the second pass has every page in one shard, whose misses are
+      // read at the same time, a thread after a page being read waiting
+      // for it
+      bufMgr = new BufMgr(num, pass == 0 ? numWorkers : 1);
+      vector<pageno_t> all(filePages);
+      Worker workers[numWorkers];
+      CALL(db.createFile("test.7"));
+      CALL(db.openFile("test.7", file1));
+      for (i = 0; i < filePages; i++) {
+	CALL(bufMgr->allocPage(file1, all[i], page));
+	if (i < numShared)
+	  sprintf((char*)page, "test.7 Page %lld shared", all[i]);
+	else {
+	  Worker& w = workers[i % numWorkers];
+	  w.own.push_back(all[i]);
+	  sprintf((char*)page, "test.7 Page %lld thread %d round %d",
+		  all[i], i % numWorkers, -1);
+	}
+	CALL(bufMgr->unPinPage(file1, all[i], true));
+      }
+      const int flushPages = 16;
+      pageno_t flushed[flushPages];
+      CALL(db.createFile("test.8"));
+      CALL(db.openFile("test.8", file2));
+      for (i = 0; i < flushPages; i++) {
+	CALL(bufMgr->allocPage(file2, flushed[i], page));
+	CALL(bufMgr->unPinPage(file2, flushed[i], true));
+      }
+      bufMgr->clearBufStats();
+      for (i = 0; i < numWorkers; i++) {
+	workers[i].id = i;
+	workers[i].file = file1;
+	workers[i].shared = &all[0];
+	workers[i].numShared = numShared;
+	workers[i].rounds = 20;
+	ASSERT(pthread_create(&workers[i].thread, NULL, runWorker, &workers[i]) == 0);
+      }
+      // test.8 is written with no shard latch held, so the workers go on
+      for (int round = 0; round < 20; round++) {
+	for (i = 0; i < flushPages; i++) {
+	  CALL(bufMgr->readPage(file2, flushed[i], page));
+	  sprintf((char*)page, "test.8 Page %lld round %d", flushed[i], round);
+	  CALL(bufMgr->unPinPage(file2, flushed[i], true));
+	}
+	CALL(bufMgr->flushFile(file2));
+      }
+      for (i = 0; i < numWorkers; i++)
+	ASSERT(pthread_join(workers[i].thread, NULL) == 0);
+      char written[PAGESIZE];
+      for (i = 0; i < flushPages; i++) {
+	CALL(file2->readPage(flushed[i], (Page*)&cmp));
+	sprintf(written, "test.8 Page %lld round %d", flushed[i], 19);
+	ASSERT(strcmp((char*)&cmp, written) == 0);
+      }
+      CALL(db.closeFile(file2));
+      CALL(db.destroyFile("test.8"));
+      // the file is twice the pool, so pages were evicted and read back
+      ASSERT(bufMgr->getBufStats().diskreads > 0);
+      for (i = 0; i < filePages; i++)
+	FAIL(bufMgr->unPinPage(file1, all[i], false));
+      CALL(bufMgr->flushFile(file1));
+      CALL(db.closeFile(file1));
+      CALL(db.openFile("test.7", file1));
+      char expect[PAGESIZE];
+      for (i = numShared; i < filePages; i++) {
+	CALL(file1->readPage(all[i], (Page*)&cmp));
+	sprintf(expect, "test.7 Page %lld thread %d round %d", all[i], i % numWorkers, 19);
+	ASSERT(strcmp((char*)&cmp, expect) == 0);
+      }
+      CALL(db.closeFile(file1));
+      CALL(db.destroyFile("test.7"));
+      delete bufMgr;
+      bufMgr = single;
+    }
+
+    cout << "Test passed" <<endl<<endl;
+
+    cout << "\nEvicting pages by LRU-2, 2Q and ARC...\n";
+    cout << "Expected Result: ";
+    cout << "Each policy picks its victims in order and forgets evicted pages in time.\n\n";
+
+    {
+      // accesses to a pool of 4 frames, and the page each one evicts
+      struct {
+	Replacement policy;
+	int maxGhosts;
+	int numAccesses;
+	pageno_t accesses[16];
+	pageno_t victims[16];
+      } patterns[] = {
+	// pages 1 and 2 are referenced twice, so pages seen once go first,
+	// and page 3 has no history left when it comes back
+	{ LRUK, 0, 11,
+	  { 1, 2, 3, 4, 1, 2, 5, 6, 7, 8, 3 },
+	  { 0, 0, 0, 0, 0, 0, 3, 4, 5, 6, 7 } },
+	// page 1 is promoted to Am from the A1out ghosts and outlives the
+	// scan; page 2 has been forgotten by then, page 7 has not
+	{ TWOQ, 2, 13,
+	  { 1, 2, 3, 4, 5, 1, 6, 7, 8, 9, 2, 7, 10 },
+	  { 0, 0, 0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 } },
+	// ghost hits on B1 (pages 4 and 6) grow the target size of T1 until
+	// T2 gives up page 1, and the B2 hit on page 1 shrinks it again
+	{ ARC, 4, 15,
+	  { 1, 2, 3, 4, 1, 5, 6, 2, 4, 7, 8, 6, 9, 1, 10 },
+	  { 0, 0, 0, 0, 0, 2, 3, 4, 5, 6, 2, 7, 1, 8, 9 } },
+      };
+      const int filePages = 40;
+      BufMgr* single = bufMgr;
+      CALL(db.createFile("test.7"));
+      CALL(db.openFile("test.7", file1));
+      CALL(file1->allocatePages(filePages, pageno));
+      ASSERT(pageno == 1);
+      for (int k = 0; k < 3; k++) {
+	bufMgr = new BufMgr(4, 1, patterns[k].policy);
+	for (i = 0; i < patterns[k].numAccesses; i++) {
+	  ASSERT(accessPage(file1, patterns[k].accesses[i], filePages)
+		 == patterns[k].victims[i]);
+	  ASSERT(bufMgr->getBufStats().ghosts <= patterns[k].maxGhosts);
+	}
+	// a long scan leaves no more ghosts than the policy keeps, but some
+	for (pageno = 11; pageno <= filePages; pageno++) {
+	  ASSERT(accessPage(file1, pageno, filePages) != 0);
+	  ASSERT(bufMgr->getBufStats().ghosts <= patterns[k].maxGhosts);
+	}
+	ASSERT((bufMgr->getBufStats().ghosts > 0) == (patterns[k].maxGhosts > 0));
+	CALL(bufMgr->flushFile(file1));
+	delete bufMgr;
+      }
+      bufMgr = single;
+      CALL(db.closeFile(file1));
+      CALL(db.destroyFile("test.7"));
+    }
+
+    cout << "Test passed" <<endl<<endl;
+
+    cout << "\nOpening files of other page sizes...\n";
+    cout << "Expected Result: ";
+    cout << "Files record their page size; 1K files predating that are upgraded.\n\n";
+
+    // a header claiming pages twice as large
+    Page raw[3];
+    FILE* f;
+    memset(raw, 0, sizeof raw);
+    ((DBPage*)&raw[0])->firstPage = -1;
+    ((DBPage*)&raw[0])->numPages = 2;
+    ((DBPage*)&raw[0])->pageSize = 2 * PAGESIZE;
+    ASSERT((f = fopen("test.8", "w")) != NULL);
+    ASSERT(fwrite(raw, sizeof(Page), 2, f) == 2 && fclose(f) == 0);
+    ASSERT(db.openFile("test.8", file1) == BADPAGESIZE);
+
+    // an old 1K header: map page 2 where pageSize now is
+    memset(raw, 0, sizeof raw);
+    int* old = (int*)&raw[0];
+    old[0] = -1;   // nextFree
+    old[1] = -1;   // firstPage
+    old[2] = 3;    // numPages
+    old[4] = 1;    // numMaps
+    old[5] = 2;    // mapPages[0]
+    ASSERT((f = fopen("test.8", "w")) != NULL);
+    ASSERT(fwrite(raw, sizeof(Page), 3, f) == 3 && fclose(f) == 0);
+    status = db.openFile("test.8", file1);
+    if (PAGESIZE != 1024) {
+      ASSERT(status == BADPAGESIZE);
+    }
+    else {
+      CALL(status);
+      CALL(file1->allocatePage(pageno));
+      ASSERT(pageno == 3);
+      CALL(db.closeFile(file1));
+      ASSERT((f = fopen("test.8", "r")) != NULL);
+      ASSERT(fread(raw, sizeof(Page), 1, f) == 1 && fclose(f) == 0);
+      ASSERT(((DBPage*)&raw[0])->pageSize == (int)PAGESIZE);
+      ASSERT(((DBPage*)&raw[0])->mapPages[0] == 2);
+      ASSERT(((DBPage*)&raw[0])->numPages == 4);
+    }
+    CALL(db.destroyFile("test.8"));
+
+    cout << "Test passed" <<endl<<endl;
+
+    cout << "\nReading and writing pages past 2GB and 4GB...\n";
+    cout << "Expected Result: ";
+    cout << "A sparse file with a 32-bit header is upgraded and used beyond 4GB;\n";
+    cout << "pages past the map pages the header can list are freed through the directory.\n\n";
+
+    const pageno_t gig2 = (1LL << 31) / PAGESIZE;   // page at offset 2GB
+    const pageno_t gig4 = (1LL << 32) / PAGESIZE;   // page at offset 4GB
+    memset(raw, 0, sizeof raw);
+    old = (int*)&raw[0];
+    old[0] = -1;             // nextFree
+    old[1] = -1;             // firstPage
+    old[2] = gig4 + 1;       // numPages
+    old[5] = PAGESIZE;       // pageSize
+    ASSERT((f = fopen("test.8", "w")) != NULL);
+    ASSERT(fwrite(raw, sizeof(Page), 1, f) == 1 && fclose(f) == 0);
+    ASSERT(truncate("test.8", (off_t)(gig4 + 1) * PAGESIZE) == 0);
+
+    CALL(db.openFile("test.8", file1));
+    CALL(bufMgr->allocPage(file1, pageno, page));
+    ASSERT(pageno == gig4 + 1);
+    CALL(bufMgr->unPinPage(file1, pageno, true));
+    const pageno_t far[] = { gig2 - 1, gig2, gig4 - 1, gig4, gig4 + 1 };
+    for (i = 0; i < 5; i++) {
+      CALL(bufMgr->readPage(file1, far[i], page));
+      sprintf((char*)page, "test.8 Page %lld", far[i]);
+      CALL(bufMgr->unPinPage(file1, far[i], true));
+    }
+    CALL(db.closeFile(file1));
+    CALL(db.openFile("test.8", file1));
+    for (i = 0; i < 5; i++) {
+      CALL(file1->readPage(far[i], (Page*)&cmp));
+      sprintf((char*)raw, "test.8 Page %lld", far[i]);
+      ASSERT(strcmp((char*)raw, (char*)&cmp) == 0);
+    }
+    // far[4] is the first page, which cannot be disposed of anyway.
+    // Each of the others is the first disposed of in its range and so
+    // becomes its map page, or, once the header is out of room, the
+    // first becomes the directory page listing the others.
+    const bool listed = (pageno_t)MAXMAPPAGES * MAPBITS <= gig2 - 1;
+    for (i = 0; i < 4; i++)
+      CALL(bufMgr->disposePage(file1, far[i]));
+    FAIL(bufMgr->disposePage(file1, far[0]));
+    CALL(db.closeFile(file1));
+    ASSERT((f = fopen("test.8", "r")) != NULL);
+    ASSERT(fread(raw, sizeof(Page), 1, f) == 1 && fclose(f) == 0);
+    ASSERT(((DBPage*)&raw[0])->numPages == gig4 + 2);
+    ASSERT(((DBPage*)&raw[0])->oldNumPages == 0);
+    if (listed) {
+      ASSERT(((DBPage*)&raw[0])->numMaps > MAXMAPPAGES);
+      ASSERT(((DBPage*)&raw[0])->mapPages[MAXMAPPAGES - 1] == gig2 - 1);
+      cout << "Map pages past " << MAXMAPPAGES - 1 << " are in the directory" << endl;
+    } else
+      ASSERT(((DBPage*)&raw[0])->numMaps == gig4 / MAPBITS + 1);
+    // the map pages are found again, and pages in their ranges are freed
+    // and reused
+    CALL(db.openFile("test.8", file1));
+    FAIL(bufMgr->disposePage(file1, far[0]));
+    CALL(bufMgr->disposePage(file1, gig2 + 1));
+    CALL(bufMgr->disposePage(file1, gig4 - 2));
+    CALL(bufMgr->allocPage(file1, pageno, page));
+    ASSERT(pageno == gig2 + 1);
+    CALL(bufMgr->unPinPage(file1, pageno, false));
+    CALL(bufMgr->allocPage(file1, pageno, page));
+    ASSERT(pageno == gig4 - 2);
+    CALL(bufMgr->unPinPage(file1, pageno, false));
+    CALL(db.closeFile(file1));
+    CALL(db.destroyFile("test.8"));
+
+    cout << "Test passed" <<endl<<endl;
+
+    cout << "\nPunching out disposed pages and compacting...\n";
+    cout << "Expected Result: ";
+    cout << "Disposed pages give their disk space back; free pages at the end are cut off.\n\n";
+
+    CALL(db.createFile("test.9"));
+    CALL(db.openFile("test.9", file1));
+    for (i = 0; i < 64; i++) {
+      CALL(bufMgr->allocPage(file1, pageno, page));
+      sprintf((char*)page, "test.9 Page %lld", pageno);
+      CALL(bufMgr->unPinPage(file1, pageno, true));
+    }
+    CALL(bufMgr->flushFile(file1));
+    ASSERT(stat("test.9", &statusBuf) == 0);
+    blkcnt_t blocks = statusBuf.st_blocks;
+    // page 1 is the first page and page 2 becomes the map page
+    for (pageno = 2; pageno <= 64; pageno++)
+      CALL(bufMgr->disposePage(file1, pageno));
+    ASSERT(stat("test.9", &statusBuf) == 0);
+    ASSERT(statusBuf.st_blocks < blocks / 2);
+    ASSERT(statusBuf.st_size == 65 * (off_t)PAGESIZE);
+    // no free page is left, so the map page goes too
+    CALL(file1->compact());
+    ASSERT(stat("test.9", &statusBuf) == 0);
+    ASSERT(statusBuf.st_size == 2 * (off_t)PAGESIZE);
+    CALL(file1->allocatePage(pageno));
+    ASSERT(pageno == 2);
+    CALL(db.closeFile(file1));
+    CALL(db.openFile("test.9", file1));
+    CALL(file1->allocatePage(pageno));
+    ASSERT(pageno == 3);
+    CALL(file1->disposePage(pageno));
+    CALL(file1->allocatePage(pageno));
+    ASSERT(pageno == 4);
+    CALL(bufMgr->readPage(file1, 1, page));
+    ASSERT(strcmp((char*)page, "test.9 Page 1") == 0);
+    CALL(bufMgr->unPinPage(file1, 1, false));
+    CALL(db.closeFile(file1));
+    // a mapped file is cut off in the middle of a system page
+    CALL(db.openFile("test.9", file1, MAPPED));
+    CALL(file1->disposePage(4));
+    CALL(file1->disposePage(2));
+    CALL(file1->compact());
+    ASSERT(stat("test.9", &statusBuf) == 0);
+    ASSERT(statusBuf.st_size == 2 * (off_t)PAGESIZE);
+    CALL(bufMgr->readPage(file1, 1, page));
+    ASSERT(page == file1->mappedPage(1));
+    ASSERT(strcmp((char*)page, "test.9 Page 1") == 0);
+    CALL(bufMgr->unPinPage(file1, 1, false));
+    ASSERT(file1->mappedPage(2) == NULL);
+    CALL(bufMgr->allocPage(file1, pageno, page));
+    ASSERT(pageno == 2);
+    strcpy((char*)page, "test.9 Page 2");
+    CALL(bufMgr->unPinPage(file1, pageno, true));
+    CALL(db.closeFile(file1));
+    CALL(db.openFile("test.9", file1));
+    CALL(file1->readPage(2, (Page*)&cmp));
+    ASSERT(strcmp((char*)&cmp, "test.9 Page 2") == 0);
+    CALL(db.closeFile(file1));
+    CALL(db.destroyFile("test.9"));
+
+    cout << "Test passed" <<endl<<endl;
+
+    cout << "\nInserting and deleting records...\n";
+    cout << "Expected Result: ";
+    cout << "Freed slots are reused last freed first, those at the end are given up; holes are squeezed out when needed.\n\n";
+
+    Page recPage;
+    Record rec;
+    RID rid;
+    char recBuf[32];
+    recPage.init(1);
+    for (i = 0; i < 10; i++) {
+      sprintf(recBuf, "record %d", i);
+      rec.data = recBuf;
+      rec.length = strlen(recBuf) + 1;
+      CALL(recPage.insertRecord(rec, rid));
+      ASSERT(rid.slotNo == i);
+    }
+    rid.pageNo = 1;
+    rid.slotNo = 2; CALL(recPage.deleteRecord(rid));
+    rid.slotNo = 7; CALL(recPage.deleteRecord(rid));
+    rid.slotNo = 4; CALL(recPage.deleteRecord(rid));
+    FAIL(recPage.deleteRecord(rid));
+    // slot 7, in the middle of the free slots, goes along with slots
+    // 9 and 8
+    rid.slotNo = 9; CALL(recPage.deleteRecord(rid));
+    rid.slotNo = 8; CALL(recPage.deleteRecord(rid));
+    for (i = 0; i < 2; i++) {
+      sprintf(recBuf, "again %d", i);
+      rec.data = recBuf;
+      rec.length = strlen(recBuf) + 1;
+      CALL(recPage.insertRecord(rec, rid));
+      ASSERT(rid.slotNo == (i == 0 ? 4 : 2));
+    }
+    rec.data = recBuf;
+    CALL(recPage.insertRecord(rec, rid));
+    ASSERT(rid.slotNo == 7);
+    CALL(recPage.insertRecord(rec, rid));
+    ASSERT(rid.slotNo == 8);
+    for (i = 0; i < 7; i++) {
+      if (i == 2 || i == 4) sprintf(recBuf, "again %d", i == 2);
+      else sprintf(recBuf, "record %d", i);
+      rid.slotNo = i;
+      CALL(recPage.getRecord(rid, rec));
+      ASSERT(strcmp((char*)rec.data, recBuf) == 0);
+    }
+
+    // deletes leave holes that an insert squeezes out when it needs to
+    recPage.init(1);
+    rec.data = recBuf;
+    rec.length = 16;
+    for (i = 0; ; i++) {
+      sprintf(recBuf, "slot %d", i);
+      if (recPage.insertRecord(rec, rid) != OK) break;
+    }
+    int full = i;
+    short freeSpace = recPage.getFreeSpace();
+    for (i = (full - 2) & ~1; i >= 0; i -= 2) {
+      rid.slotNo = i;
+      CALL(recPage.deleteRecord(rid));
+    }
+    ASSERT(recPage.getFragmentedSpace() == recPage.getFreeSpace() - freeSpace);
+    for (i = 0; i < full - 1; i += 2) {
+      sprintf(recBuf, "slot %d", i);
+      CALL(recPage.insertRecord(rec, rid));
+      ASSERT(rid.slotNo == i);
+    }
+    FAIL(recPage.insertRecord(rec, rid));
+    ASSERT(recPage.getFragmentedSpace() == 0);
+    rid.slotNo = 1;
+    CALL(recPage.deleteRecord(rid));
+    ASSERT(recPage.getFragmentedSpace() == 16);
+    recPage.compact();
+    ASSERT(recPage.getFragmentedSpace() == 0);
+    for (i = 0; i < full; i++) {
+      rid.slotNo = i;
+      if (i == 1) {
+        FAIL(recPage.getRecord(rid, rec));
+        continue;
+      }
+      sprintf(recBuf, "slot %d", i);
+      CALL(recPage.getRecord(rid, rec));
+      ASSERT(strcmp((char*)rec.data, recBuf) == 0);
+    }
+
+    // batches of records come back as firstRecord/nextRecord see them
+    for (i = 5; i < full - 1; i++)
+      if (i % 7 < 4 || i % 11 == 0) {
+        rid.slotNo = i;
+        CALL(recPage.deleteRecord(rid));
+      }
+    for (int batch = 1; batch <= full; batch += 4) {
+      PageRecord recs[PAGESIZE / sizeof(slot_t)];
+      int slotNo = 0, count, n = 0;
+      RID nextRid;
+      Status status = recPage.firstRecord(rid);
+      while (recPage.getRecords(slotNo, recs, batch, count) == OK)
+        for (int k = 0; k < count; k++, n++) {
+          CALL(status);
+          ASSERT(recs[k].rid.pageNo == 1 && recs[k].rid.slotNo == rid.slotNo);
+          CALL(recPage.getRecord(rid, rec));
+          ASSERT(recs[k].data == rec.data && recs[k].length == rec.length);
+          status = recPage.nextRecord(rid, nextRid);
+          rid = nextRid;
+        }
+      ASSERT(status == ENDOFPAGE && n > 0);
+    }
+
+    cout << "Test passed" <<endl<<endl;
+
+    cout << "\nInserting, deleting and scanning heap file records...\n";
+    cout << "Expected Result: ";
+    cout << "Every live record scanned once, in page order.\n\n";
+
+    const int heapRecs = 2000;
+    vector<RID> heapRids(heapRecs + 1);
+    CALL(createHeapFile("test.10"));
+    HeapFile* heap = new HeapFile("test.10", status);
+    CALL(status);
+    for (i = 0; i < heapRecs; i++) {
+      sprintf(recBuf, "heap record %d", i);
+      rec.data = recBuf;
+      rec.length = strlen(recBuf) + 1 + i % 13;
+      CALL(heap->insertRecord(rec, heapRids[i]));
+    }
+    ASSERT(heap->getRecCnt() == heapRecs);
+    rec.length = PAGESIZE;
+    ASSERT(heap->insertRecord(rec, rid) == INVALIDRECLEN);
+    for (i = 0; i < heapRecs; i += 3)
+      CALL(heap->deleteRecord(heapRids[i]));
+    ASSERT(heap->getRecCnt() == heapRecs - (heapRecs + 2) / 3);
+    for (i = 1; i < heapRecs; i += 3) {
+      sprintf(recBuf, "heap record %d", i);
+      CALL(heap->getRecord(heapRids[i], rec));
+      ASSERT(strcmp((char*)rec.data, recBuf) == 0 && rec.length == (int)strlen(recBuf) + 1 + i % 13);
+    }
+    FAIL(heap->getRecord(heapRids[0], rec));
+    // the header and map pages are among the data pages, and hold no records
+    int notData = 0;
+    for (rid.pageNo = 1; rid.pageNo < heapRids[heapRecs - 1].pageNo; rid.pageNo++) {
+      bool isData = false;
+      for (i = 0; i < heapRecs && !isData; i++)
+        isData = heapRids[i].pageNo == rid.pageNo;
+      if (isData) continue;
+      rid.slotNo = 0;
+      ASSERT(heap->getRecord(rid, rec) == BADRID);
+      ASSERT(heap->deleteRecord(rid) == BADRID);
+      notData++;
+    }
+    ASSERT(notData >= 2);
+    ASSERT(heap->getRecCnt() == heapRecs - (heapRecs + 2) / 3);
+    delete heap;
+
+    // delete every fifth record as the first scan passes it, and add
+    // one more half way
+    HeapFileScan* scan = new HeapFileScan("test.10", status);
+    CALL(status);
+    for (int pass = 0; pass < 2; pass++) {
+      int scanned = 0, last = -1;
+      bool sawAdded = false;
+      CALL(scan->startScan());
+      while ((status = scan->scanNext(rid, rec)) == OK) {
+        int recNo;
+        ASSERT(sscanf((char*)rec.data, "heap record %d", &recNo) == 1);
+        ASSERT(rid.pageNo == heapRids[recNo].pageNo && rid.slotNo == heapRids[recNo].slotNo);
+        // the record added goes on the page being scanned, where
+        // the scan may have passed the slot it takes
+        if (recNo == heapRecs)
+          sawAdded = true;
+        else {
+          ASSERT(recNo > last && recNo % 3 != 0);
+          last = recNo;
+        }
+        ASSERT(pass == 0 || recNo % 5 != 0 || recNo == heapRecs);
+        if (pass == 0 && recNo % 5 == 0 && recNo != heapRecs)
+          CALL(scan->deleteRecord(rid));
+        if (pass == 0 && recNo == heapRecs / 2) {
+          Record added;
+          sprintf(recBuf, "heap record %d", heapRecs);
+          added.data = recBuf;
+          added.length = strlen(recBuf) + 1;
+          CALL(scan->insertRecord(added, heapRids[heapRecs]));
+        }
+        scanned++;
+      }
+      ASSERT(status == FILEEOF);
+      ASSERT(scan->scanNext(rid, rec) == FILEEOF);
+      ASSERT(last == heapRecs - 1 && (pass == 0 || sawAdded));
+      ASSERT(scanned == (pass == 0 ? heapRecs - (heapRecs + 2) / 3 + sawAdded : scan->getRecCnt()));
+      CALL(scan->endScan());
+    }
+    delete scan;
+
+    // new records fill the space freed, from the first page on
+    heap = new HeapFile("test.10", status);
+    CALL(status);
+    int heapCnt = heap->getRecCnt();
+    for (i = 0; i < heapRecs / 4; i++) {
+      sprintf(recBuf, "refill %d", i);
+      rec.data = recBuf;
+      rec.length = strlen(recBuf) + 1;
+      CALL(heap->insertRecord(rec, rid));
+      ASSERT(rid.pageNo <= heapRids[heapRecs - 1].pageNo);
+      ASSERT(i > 0 || rid.pageNo == heapRids[0].pageNo);
+    }
+    ASSERT(heap->getRecCnt() == heapCnt + heapRecs / 4);
+    delete heap;
+    CALL(destroyHeapFile("test.10"));
+
+    cout << "Test passed" <<endl<<endl;
+
+    cout << "\nReading ahead of a scan of a heap file whose pages are out of order...\n";
+    cout << "Expected Result: ";
+    cout << "Only pages on the chain are read ahead.\n\n";
+
+    {
+      // after each data page, two pages of the file are taken through
+      // another open of it, and later disposed of
+      CALL(createHeapFile("test.10"));
+      heap = new HeapFile("test.10", status);
+      CALL(status);
+      CALL(db.openFile("test.10", file1));
+      vector<pageno_t> between;
+      pageno_t lastData = -1;
+      strcpy(recBuf, "heap record");
+      rec.data = recBuf;
+      rec.length = PAGESIZE / 3;
+      for (i = 0; (int)between.size() < 24; i++) {
+	CALL(heap->insertRecord(rec, rid));
+	if (rid.pageNo == lastData) continue;
+	lastData = rid.pageNo;
+	for (int k = 0; k < 2; k++) {
+	  CALL(bufMgr->allocPage(file1, pageno, page));
+	  CALL(bufMgr->unPinPage(file1, pageno, true));
+	  between.push_back(pageno);
+	}
+      }
+      delete heap;
+      for (int k = 0; k < (int)between.size(); k++)
+	CALL(bufMgr->disposePage(file1, between[k]));
+
+      HeapFileScan* scan = new HeapFileScan("test.10", status);
+      CALL(status);
+      CALL(scan->startScan());
+      int scanned = 0;
+      while ((status = scan->scanNext(rid, rec)) == OK)
+	scanned++;
+      ASSERT(status == FILEEOF && scanned == i);
+      CALL(scan->endScan());
+      delete scan;
+
+      // once a page queued after the scan has been read ahead, so has
+      // everything the scan queued
+      CALL(db.createFile("test.11"));
+      CALL(db.openFile("test.11", file2));
+      CALL(bufMgr->allocPage(file2, pageno2, page));
+      CALL(bufMgr->unPinPage(file2, pageno2, true));
+      CALL(bufMgr->flushFile(file2));
+      CALL(bufMgr->prefetch(file2, pageno2, 1));
+      for (int k = 0; k < 5000 && bufMgr->unPinPage(file2, pageno2, false) != PAGENOTPINNED; k++)
+	usleep(1000);
+      ASSERT(bufMgr->unPinPage(file2, pageno2, false) == PAGENOTPINNED);
+      for (int k = 0; k < (int)between.size(); k++)
+	ASSERT(bufMgr->unPinPage(file1, between[k], false) == HASHNOTFOUND);
+      CALL(db.closeFile(file2));
+      CALL(db.destroyFile("test.11"));
+      CALL(db.closeFile(file1));
+      CALL(destroyHeapFile("test.10"));
+    }
+
+    cout << "Test passed" <<endl<<endl;
+
+    cout << "\nReusing space freed through another instance of a heap file...\n";
+    cout << "Expected Result: ";
+    cout << "A file open twice sees the space freed through either.\n\n";
+
+    // records of an eighth of a page, so that each insert that finds the
+    // current page full searches the space map, and finds nothing
+    vector<RID> spaceRids;
+    CALL(createHeapFile("test.10"));
+    heap = new HeapFile("test.10", status);
+    CALL(status);
+    memset(&cmp, 'x', sizeof cmp);
+    rec.data = &cmp;
+    rec.length = PAGESIZE / 8;
+    for (i = 0; i < 20; i++) {
+      CALL(heap->insertRecord(rec, rid));
+      spaceRids.push_back(rid);
+    }
+    ASSERT(spaceRids.back().pageNo > spaceRids[0].pageNo + 1);
+    HeapFile* other = new HeapFile("test.10", status);
+    CALL(status);
+    for (i = 0; spaceRids[i].pageNo == spaceRids[0].pageNo; i++)
+      CALL(other->deleteRecord(spaceRids[i]));
+    delete other;
+    bool reused = false;
+    for (i = 0; i < 8 && !reused; i++) {
+      CALL(heap->insertRecord(rec, rid));
+      reused = rid.pageNo == spaceRids[0].pageNo;
+    }
+    ASSERT(reused);
+    delete heap;
+    CALL(destroyHeapFile("test.10"));
+
+    cout << "Test passed" <<endl<<endl;
+
+    CALL(db.closeFile(file5));
+    CALL(db.closeFile(file6));
+    CALL(db.destroyFile("test.5"));
+    CALL(db.destroyFile("test.6"));
+
     delete bufMgr;
 
     cout << endl << "Passed all tests." << endl;